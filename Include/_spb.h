@@ -25,6 +25,20 @@
 
 #define DEFAULT_SPB_BUFFER_SIZE 256
 
+//
+// Every FTS_Read/FTS_Write goes through the default buffers together with a
+// 9 byte header and CRC, so callers must keep their payload within this
+//
+#define FTS_MAX_TRANSFER_LENGTH (DEFAULT_SPB_BUFFER_SIZE - 9)
+
+//
+// CRC-16/Kermit engine used to validate reads: 0 selects the bit-at-a-time
+// loop, 1 a byte-wise lookup table, 4 or 8 a slice-by-N lookup table
+//
+#ifndef FTS_CRC_SLICE_BY
+#define FTS_CRC_SLICE_BY 8
+#endif
+
 //
 // SPB (I2C) context
 //
@@ -36,10 +50,19 @@ typedef struct _SPB_CONTEXT
     WDFMEMORY WriteMemory;
     WDFMEMORY ReadMemory;
     WDFWAITLOCK SpbLock;
+
+    //
+    // Transfers issued and, of those, transfers rejected for not fitting the
+    // default buffers. Touch frames, register accesses and ECC commands all
+    // fit them, firmware packets bypass them
+    //
+    ULONG Transfers;
+    ULONG Rejected;
 } SPB_CONTEXT;
 
 NTSTATUS FTS_Write(IN SPB_CONTEXT* SpbContext, IN UINT8* cmd, IN UINT32 writelen);
 NTSTATUS FTS_Read(IN SPB_CONTEXT * SpbContext, IN UINT8 * cmd, OUT UINT8 * data, IN UINT32 datalen);
+NTSTATUS FTS_WriteGather(IN SPB_CONTEXT* SpbContext, IN UINT8 cmd, IN UINT8* data, IN UINT32 datalen);
 
 VOID
 SpbTargetDeinitialize(
@@ -13,4 +13,21 @@
 
 #define FTS_APP_INFO_OFFSET 0x100
 
+//
+// Polling of the application after FTS_ROMBOOT_CMD_START_APP, in
+// milliseconds. The poll interval doubles from MIN up to MAX until the
+// firmware answers or the timeout expires
+//
+#define FTS_APP_READY_TIMEOUT_MS 1500
+#define FTS_APP_READY_POLL_MIN_MS 5
+#define FTS_APP_READY_POLL_MAX_MS 100
+
+//
+// Compute the host side firmware ECC with lookup tables instead of the
+// bit-at-a-time loop
+//
+#ifndef FTS_ECC_USE_TABLE
+#define FTS_ECC_USE_TABLE 1
+#endif
+
 NTSTATUS FTLoadFirmwareFile(WDFDEVICE Device, SPB_CONTEXT* SpbContext);
\ No newline at end of file
@@ -36,6 +36,27 @@ typedef struct _PTP_DEVICE_HQA_CERTIFICATION_REPORT {
 	UCHAR CertificationBlob[256];
 } PTP_DEVICE_HQA_CERTIFICATION_REPORT, * PPTP_DEVICE_HQA_CERTIFICATION_REPORT;
 
+// REPORTID_COUNTERS
+typedef struct _HID_COUNTERS_FEATURE_REPORT {
+	UCHAR ReportID;
+	UCHAR Reserved[3];
+
+	//
+	// SPB transfers issued, and those rejected for not fitting the default
+	// buffers
+	//
+	ULONG SpbTransfers;
+	ULONG SpbRejected;
+
+	//
+	// Adaptive touch frame reads, those that needed a second read and those
+	// that fell back to reading the whole frame
+	//
+	ULONG TouchFrameReads;
+	ULONG TouchFrameSecondReads;
+	ULONG TouchFrameFullReads;
+} HID_COUNTERS_FEATURE_REPORT, * PHID_COUNTERS_FEATURE_REPORT;
+
 // 
 // Type defintions
 //
@@ -60,9 +81,24 @@ typedef struct _HID_TOUCH_FINGER {
 
 typedef struct _HID_TOUCH_REPORT {
 	HID_TOUCH_FINGER Contacts[10];
+	USHORT           ScanTime;
 	UCHAR            ContactCount;
 } HID_TOUCH_REPORT, * PHID_TOUCH_REPORT;
 
+// REPORTID_FINGER with contact size reporting enabled
+typedef struct _HID_TOUCH_FINGER_EX {
+	HID_TOUCH_FINGER Finger;
+	UCHAR		Width : 4;
+	UCHAR		Height : 4;
+	UCHAR		Pressure;
+} HID_TOUCH_FINGER_EX, * PHID_TOUCH_FINGER_EX;
+
+typedef struct _HID_TOUCH_REPORT_EX {
+	HID_TOUCH_FINGER_EX Contacts[10];
+	USHORT           ScanTime;
+	UCHAR            ContactCount;
+} HID_TOUCH_REPORT_EX, * PHID_TOUCH_REPORT_EX;
+
 // REPORTID_KEYPAD
 typedef struct _HID_KEY_REPORT {
 	UCHAR  SystemPowerDown : 1;
@@ -99,6 +135,7 @@ typedef struct _HID_INPUT_REPORT
 	union
 	{
 		HID_TOUCH_REPORT TouchReport;
+		HID_TOUCH_REPORT_EX TouchReportEx;
 		HID_PEN_REPORT   PenReport;
 		HID_KEY_REPORT   KeyReport;
 	};
@@ -110,6 +147,38 @@ typedef struct _HID_INPUT_REPORT
 #include <poppack.h>
 #pragma warning(pop)
 
+//
+// Length of a pen or key input report on the wire. Finger reports follow
+// the layout in use, see HID_FINGER_REPORT_LENGTH
+//
+#define HID_INPUT_REPORT_LENGTH \
+	(sizeof(HID_INPUT_REPORT) - sizeof(HID_TOUCH_REPORT_EX) + sizeof(HID_TOUCH_REPORT))
+
+//
+// Report descriptor generated for the report layout and screen properties
+// in use, built once when the device starts and served from here. It is
+// only generated again when one of them changed
+//
+#define HID_REPORT_DESCRIPTOR_MAX_LENGTH  1024
+
+typedef struct _HID_REPORT_DESCRIPTOR_CACHE
+{
+	BOOLEAN Built;
+	BOOLEAN ContactSize;
+	ULONG ContactsPerReport;
+	UINT32 DisplayWidth;
+	UINT32 DisplayHeight;
+
+	ULONG Length;
+	UCHAR Descriptor[HID_REPORT_DESCRIPTOR_MAX_LENGTH];
+
+	//
+	// Length of the finger input report the descriptor declares, report
+	// ID included
+	//
+	ULONG FingerReportLength;
+} HID_REPORT_DESCRIPTOR_CACHE;
+
 //
 // Function prototypes
 //
@@ -117,7 +186,13 @@ typedef struct _HID_INPUT_REPORT
 NTSTATUS
 TchSendReport(
 	IN WDFQUEUE PingPongQueue,
-	IN PHID_INPUT_REPORT hidReportFromDriver
+	IN PHID_INPUT_REPORT hidReportFromDriver,
+	IN ULONG hidReportLength
+);
+
+NTSTATUS
+TchBuildReportDescriptor(
+	IN WDFDEVICE Device
 );
 
 NTSTATUS
@@ -177,33 +252,72 @@ TchReadReport(
 #define X_MASK 0x38, 0x04
 #define Y_MASK 0x60, 0x09
 
-#define FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT \
-	BEGIN_COLLECTION, 0x02, /* Collection (Logical) */ \
-		USAGE, 0x42, /* Usage (Tip Switch) */ \
-		LOGICAL_MINIMUM, 0x00, /* Logical Minimum (0) */ \
-		LOGICAL_MAXIMUM, 0x01, /* Logical Maximum (1) */ \
-		REPORT_SIZE, 0x01, /* Report Size (1) */ \
-		REPORT_COUNT, 0x01, /* Report Count (1) */ \
-		INPUT, 0x02, /* Input: (Data, Var, Abs) */ \
-		USAGE, 0x32, /* Usage (In Range) */ \
-		INPUT, 0x02, /* Input: (Data, Var, Abs) */ \
-		USAGE, 0x47, /* Usage (Confidence) */ \
-		INPUT, 0x02, /* Input: (Data, Var, Abs) */ \
-		REPORT_COUNT, 0x05, /* Report Count (5) */ \
-		INPUT, 0x03, /* Input (Const,Var,Abs,No Wrap,Linear,Preferred State,No Null Position) */ \
-		REPORT_SIZE, 0x08, /* Report Size (8) */ \
-		USAGE, 0x51, /* Usage (Contract Identifier) */ \
-		REPORT_COUNT, 0x01, /* Report Count (1) */ \
-		INPUT, 0x02, /* Input: (Data, Var, Abs) */ \
-		USAGE_PAGE, 0x01, /* Usage Page (Generic Desktop Ctrls) */ \
-		LOGICAL_MAXIMUM_2, X_MASK, /* Logical Maximum (1600) */ \
-		REPORT_SIZE, 0x10, /* Report Size (16) */ \
-		USAGE, 0x30, /* Usage (X) */ \
-		INPUT, 0x02, /* Input: (Data, Var, Abs) */ \
-		LOGICAL_MAXIMUM_2, Y_MASK, /* Logical Maximum (2560) */ \
-		USAGE, 0x31, /* Usage (Y) */ \
-		INPUT, 0x02, /* Input: (Data, Var, Abs) */ \
-	END_COLLECTION /* End Collection */
+//
+// Finger collection fields, generated by TchBuildReportDescriptor. Each
+// entry is FIELD(usage page, usage, report size, report count, logical
+// maximum, unit, input flags) in report order, a zero usage is padding.
+// The same tables size HID_TOUCH_FINGER and HID_TOUCH_FINGER_EX at compile
+// time.
+// Logical maxima of HID_LOGICAL_MAX_DISPLAY_WIDTH/HEIGHT are replaced by
+// the display size from the screen properties
+//
+#define HID_USAGE_PAGE_GENERIC        0x01
+#define HID_USAGE_PAGE_DIGITIZER      0x0D
+
+#define HID_INPUT_DATA                0x02
+#define HID_INPUT_CONSTANT            0x03
+
+//
+// Units carry the unit exponent above the 16-bit unit code
+//
+#define HID_UNIT_NONE                 0x000000
+#define HID_UNIT_SECONDS_E_MINUS_4    0x0C1001
+
+#define HID_LOGICAL_MAX_DISPLAY_WIDTH  0xFEFE
+#define HID_LOGICAL_MAX_DISPLAY_HEIGHT 0xFDFD
+
+#define HID_FINGER_LOGICAL_MAX_X      0x0438
+#define HID_FINGER_LOGICAL_MAX_Y      0x0960
+
+#define HID_FINGER_CONTACT_FIELDS(FIELD) \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x42, 1, 1, 1, HID_UNIT_NONE, HID_INPUT_DATA) /* Tip Switch */ \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x32, 1, 1, 1, HID_UNIT_NONE, HID_INPUT_DATA) /* In Range */ \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x47, 1, 1, 1, HID_UNIT_NONE, HID_INPUT_DATA) /* Confidence */ \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x00, 1, 5, 1, HID_UNIT_NONE, HID_INPUT_CONSTANT) /* Padding */ \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x51, 8, 1, PTP_MAX_CONTACT_POINTS - 1, HID_UNIT_NONE, HID_INPUT_DATA) /* Contact Identifier */ \
+	FIELD(HID_USAGE_PAGE_GENERIC, 0x30, 16, 1, HID_FINGER_LOGICAL_MAX_X, HID_UNIT_NONE, HID_INPUT_DATA) /* X */ \
+	FIELD(HID_USAGE_PAGE_GENERIC, 0x31, 16, 1, HID_FINGER_LOGICAL_MAX_Y, HID_UNIT_NONE, HID_INPUT_DATA) /* Y */
+
+//
+// Appended to every contact when contact size reporting is enabled. The
+// controller reports a single area, it is sent as both width and height
+//
+#define HID_FINGER_SIZE_FIELDS(FIELD) \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x48, 4, 1, 15, HID_UNIT_NONE, HID_INPUT_DATA) /* Width */ \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x49, 4, 1, 15, HID_UNIT_NONE, HID_INPUT_DATA) /* Height */ \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x30, 8, 1, 255, HID_UNIT_NONE, HID_INPUT_DATA) /* Tip Pressure */
+
+//
+// Scan time and contact count follow the contacts
+//
+#define HID_FINGER_REPORT_FIELDS(FIELD) \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x56, 16, 1, 0xFFFF, HID_UNIT_SECONDS_E_MINUS_4, HID_INPUT_DATA) /* Scan Time */ \
+	FIELD(HID_USAGE_PAGE_DIGITIZER, 0x54, 8, 1, PTP_MAX_CONTACT_POINTS, HID_UNIT_NONE, HID_INPUT_DATA) /* Contact Count */
+
+#define HID_FIELD_BITS(UsagePage, Usage, ReportSize, ReportCount, LogicalMaximum, Unit, Flags) \
+	+ (ReportSize) * (ReportCount)
+
+#define HID_FINGER_CONTACT_BITS (0 HID_FINGER_CONTACT_FIELDS(HID_FIELD_BITS))
+#define HID_FINGER_SIZE_BITS    (0 HID_FINGER_SIZE_FIELDS(HID_FIELD_BITS))
+#define HID_FINGER_REPORT_BITS  (0 HID_FINGER_REPORT_FIELDS(HID_FIELD_BITS))
+
+//
+// Length of a finger report with the given number of contacts, report ID
+// included
+//
+#define HID_FINGER_REPORT_LENGTH(Contacts, ContactSize) \
+	(1 + (Contacts) * ((ContactSize) ? sizeof(HID_TOUCH_FINGER_EX) : sizeof(HID_TOUCH_FINGER)) + \
+	HID_FINGER_REPORT_BITS / 8)
 
 #define FOCALTECH_FT5X_DIGITIZER_STYLUS_CONTACT_1 \
 	BEGIN_COLLECTION, 0x00, /* Collection (Physical) */ \
@@ -328,58 +442,6 @@ TchReadReport(
 		FEATURE, 0x02, /* Feature: (Data, Var, Abs) */ \
 	END_COLLECTION /* End Collection */
 
-#define FOCALTECH_FT5X_DIGITIZER_FINGER \
-	USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-	USAGE, 0x04, /* Usage (Touch Screen) */ \
-	BEGIN_COLLECTION, 0x01, /* Collection (Application) */ \
-		REPORT_ID, REPORTID_FINGER, /* Report ID (1) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (1) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (2) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (3) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (4) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (5) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (6) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (7) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (8) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (9) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x22, /* Usage (Finger) */ \
-		FOCALTECH_FT5X_DIGITIZER_FINGER_CONTACT, /* Finger Contact (10) */ \
-		USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
-		USAGE, 0x54, /* Usage (Contact Count) */ \
-		REPORT_SIZE, 0x08, /* Report Size (8) */ \
-		INPUT, 0x02, /* Input: (Data, Var, Abs) */ \
-		REPORT_ID, REPORTID_DEVICE_CAPS, /* Report ID (8) */ \
-		USAGE, 0x55, /* Usage (Maximum Contacts) */ \
-		LOGICAL_MAXIMUM, 0x0a, /* Logical Maximum (10) */ \
-		FEATURE, 0x02, /* Feature: (Data, Var, Abs) */ \
-		USAGE_PAGE_1, 0x00, 0xff, \
-		REPORT_ID, REPORTID_PTPHQA, \
-		USAGE, 0xc5, \
-		LOGICAL_MINIMUM, 0x00, \
-		LOGICAL_MAXIMUM_2, 0xff, 0x00, \
-		REPORT_SIZE, 0x08, \
-		REPORT_COUNT_2, 0x00, 0x01, \
-		FEATURE, 0x02, \
-	END_COLLECTION /* End Collection */
-
 #define FOCALTECH_FT5X_DIGITIZER_REPORTMODE \
 	USAGE_PAGE, 0x0D, /* Usage Page (Digitizer) */ \
 	USAGE, 0x0E, /* Usage (Configuration) */ \
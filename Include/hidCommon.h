@@ -19,6 +19,9 @@
 #define REPORTID_DIAGNOSTIC_3 0xF4
 #define REPORTID_DIAGNOSTIC_4 0xF5
 #define REPORTID_DIAGNOSTIC_FEATURE_4 0xF6
+#define REPORTID_TRACE 0xF7
+#define REPORTID_LATENCY 0xF8
+#define REPORTID_COUNTERS 0xF9
 
 #define REPORTID_FINGER 0x01
 #define REPORTID_REPORTMODE 0x07
@@ -107,6 +107,11 @@ typedef struct _DEVICE_EXTENSION
     //
     REPORT_CONTEXT ReportContext;
 
+    //
+    // Report descriptor patched for this screen
+    //
+    HID_REPORT_DESCRIPTOR_CACHE ReportDescriptor;
+
 	//
 	// PTP New
 	//
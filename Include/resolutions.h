@@ -26,6 +26,36 @@
 #define TOUCH_DEVICE_RESOLUTION_X   1440
 #define TOUCH_DEVICE_RESOLUTION_Y   2560
 
+//
+// Controller to display translation compiled from the screen properties.
+// Each output axis is one row of a 2x3 matrix over the clamped controller
+// coordinates, followed by the touch clip, the scale as a fixed-point
+// reciprocal and the display clip
+//
+typedef struct _TOUCH_TRANSFORM_AXIS
+{
+    LONGLONG Matrix[3];
+    LONGLONG TouchClipLow;
+    LONGLONG TouchShift;
+    LONGLONG TouchClipHigh;
+    ULONGLONG ScaleMultiplier;
+    ULONG ScaleShift;
+    LONGLONG DisplayClipLow;
+    LONGLONG DisplayShift;
+    LONGLONG DisplayClipHigh;
+} TOUCH_TRANSFORM_AXIS;
+
+typedef struct _TOUCH_TRANSFORM
+{
+    //
+    // FALSE when the properties fall outside the range the fixed-point
+    // form is exact for, coordinates then take the generic path
+    //
+    BOOLEAN Valid;
+    LONGLONG InputMax[2];
+    TOUCH_TRANSFORM_AXIS Axis[2];
+} TOUCH_TRANSFORM;
+
 typedef struct _TOUCH_SCREEN_PROPERTIES
 {
     UINT32 TouchSwapAxes;
@@ -49,6 +79,11 @@ typedef struct _TOUCH_SCREEN_PROPERTIES
     UINT32 DisplayHeight10um;
     UINT32 DisplayWidth10um;
     UINT32 TouchHardwareLacksContinuousReporting;
+
+    //
+    // Not read from the registry, built by TchGetScreenProperties
+    //
+    TOUCH_TRANSFORM Transform;
 } TOUCH_SCREEN_PROPERTIES, * PTOUCH_SCREEN_PROPERTIES;
 
 VOID
@@ -62,3 +97,11 @@ TchTranslateToDisplayCoordinates(
 	IN PUSHORT Y,
 	IN PTOUCH_SCREEN_PROPERTIES Props
 );
+
+VOID
+TchTransformToDisplayCoordinates(
+	IN OUT PUSHORT X,
+	IN OUT PUSHORT Y,
+	IN ULONG Count,
+	IN PTOUCH_SCREEN_PROPERTIES Props
+);
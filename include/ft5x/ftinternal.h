@@ -33,6 +33,8 @@
 #define FTS_CMD_START2  0xAA
 #define FTS_CMD_READ_ID 0x90
 
+#define FTS_REG_FW_VER  0xA6
+
 // Ignore warning C4152: nonstandard extension, function/data pointer conversion in expression
 #pragma warning (disable : 4152)
 
@@ -181,8 +183,63 @@ typedef struct _FT5X_CONFIGURATION
 	FT5X_F01_CTRL_REGISTERS_LOGICAL DeviceSettings;
 	FT5X_F11_CTRL_REGISTERS_LOGICAL TouchSettings;
 	UINT32 PepRemovesVoltageInD3;
+	UINT32 TouchReadMode;
+	UINT32 SuppressStationaryReports;
+	UINT32 StationaryKeepAliveMs;
+	UINT32 PredictionHorizonMs;
+	UINT32 PredictionMaxDistance;
+	UINT32 ReportContactSize;
+	UINT32 PalmRejection;
+	UINT32 PalmWeightThreshold;
+	UINT32 ContactsPerReport;
 } FT5X_CONFIGURATION;
 
+//
+// TouchReadMode values: always read every point slot, or read as many slots
+// as the previous frame reported and fetch the rest only when needed. The
+// adaptive read relies on the controller packing the point records of a
+// frame at the front rather than keeping them at the index of their touch
+// id. A frame whose records do not account for the touch point count in the
+// header is read in full instead
+//
+#define FT5X_TOUCH_READ_FULL      0
+#define FT5X_TOUCH_READ_ADAPTIVE  1
+
+//
+// Touch frame layout starting at register 0x01: gesture id, number of
+// touch points and FT5X_MAX_TOUCH_POINTS point records
+//
+#define FT5X_TOUCH_DATA_REG       0x01
+#define FT5X_TOUCH_HEADER_SIZE    2
+#define FT5X_TOUCH_POINT_SIZE     6
+#define FT5X_MAX_TOUCH_POINTS     10
+#define FT5X_TOUCH_FRAME_SIZE     90
+
+//
+// Point records of a touch frame unpacked into one array per field
+//
+typedef struct _FT5X_TOUCH_FRAME
+{
+	UINT16 X[FT5X_MAX_TOUCH_POINTS];
+	UINT16 Y[FT5X_MAX_TOUCH_POINTS];
+	UINT8 Id[FT5X_MAX_TOUCH_POINTS];
+	UINT8 Event[FT5X_MAX_TOUCH_POINTS];
+	UINT8 Weight[FT5X_MAX_TOUCH_POINTS];
+	UINT8 Area[FT5X_MAX_TOUCH_POINTS];
+} FT5X_TOUCH_FRAME;
+
+//
+// Unpack point records with NEON on ARM64, other targets and the tail of the
+// frame use the scalar decoder
+//
+#ifndef FT5X_DECODE_SIMD
+#if defined(_M_ARM64)
+#define FT5X_DECODE_SIMD 1
+#else
+#define FT5X_DECODE_SIMD 0
+#endif
+#endif
+
 typedef struct _FT5X_CONTROLLER_CONTEXT
 {
 	WDFDEVICE FxDevice;
@@ -203,6 +260,27 @@ typedef struct _FT5X_CONTROLLER_CONTEXT
 
 	BYTE MaxFingers;
 
+	//
+	// Firmware version reported by the running application (0 if unknown),
+	// and the version that was running after our last successful download
+	// along with the size and host ECC of the image that was downloaded.
+	// The latter are also kept in the device key to survive a driver restart
+	//
+	BYTE FirmwareVersion;
+	BYTE LoadedFirmwareVersion;
+	ULONG LoadedFirmwareImageSize;
+	USHORT LoadedFirmwareImageEcc;
+
+	//
+	// Adaptive touch frame reads: point slots to read up front, how often
+	// that prediction was too small and a second read was needed, and how
+	// often the records were not packed and the whole frame had to be read
+	//
+	BYTE PredictedTouchPoints;
+	ULONG TouchFrameReads;
+	ULONG TouchFrameSecondReads;
+	ULONG TouchFrameFullReads;
+
     int HidQueueCount;
 } FT5X_CONTROLLER_CONTEXT;
 
@@ -273,6 +351,20 @@ Ft5xGetFirmwareVersion(
     IN SPB_CONTEXT* SpbContext
 );
 
+VOID
+Ft5xDecodeTouchFrameScalar(
+    IN const FOCAL_TECH_TOUCH_DATA* Records,
+    IN UINT8 First,
+    IN UINT8 Count,
+    OUT FT5X_TOUCH_FRAME* Frame
+);
+
+VOID
+Ft5xDecodeTouchFrame(
+    IN const FOCAL_TECH_TOUCH_DATA* Records,
+    OUT FT5X_TOUCH_FRAME* Frame
+);
+
 NTSTATUS
 Ft5xCheckInterrupts(
     IN FT5X_CONTROLLER_CONTEXT* ControllerContext,
@@ -36,6 +36,8 @@ typedef struct _OBJECT_INFO
 	int x;
 	int y;
 	UCHAR status;
+	UCHAR weight;
+	UCHAR area;
 } OBJECT_INFO;
 
 typedef struct _OBJECT_CACHE
@@ -43,11 +45,20 @@ typedef struct _OBJECT_CACHE
 	OBJECT_INFO Slot[MAX_TOUCHES];
 	UINT32 SlotValid;
 	UINT32 SlotDirty;
-	int DownOrder[MAX_TOUCHES];
+
+	//
+	// Slots in the order they went down, one nibble per slot starting at
+	// the least significant nibble. Only the first DownCount nibbles are
+	// meaningful
+	//
+	ULONGLONG DownQueue;
 	int DownCount;
 	ULONG64 ScanTime;
 } OBJECT_CACHE;
 
+#define OBJECT_CACHE_DOWN_ORDER(Cache, n) \
+	((int)(((Cache)->DownQueue >> (4 * (n))) & 0xF))
+
 typedef struct _DETECTED_OBJECT_POSITION
 {
 	int X;
@@ -68,6 +79,30 @@ typedef struct _DETECTED_OBJECTS
 {
 	OBJECT_STATE States[MAX_TOUCHES];
 	DETECTED_OBJECT_POSITION Positions[MAX_TOUCHES];
+
+	//
+	// Slots the controller explicitly reported as lifted in this frame,
+	// Positions holds the lift position for them
+	//
+	UINT32 Lifted;
+
+	//
+	// Contact pressure and size as reported by the controller
+	//
+	UCHAR Weights[MAX_TOUCHES];
+	UCHAR Areas[MAX_TOUCHES];
+
+	//
+	// Performance counter value taken when the frame's interrupt fired
+	//
+	LARGE_INTEGER Timestamp;
+
+	//
+	// Performance counter values taken once the frame was read from the
+	// controller and once it was decoded
+	//
+	LONGLONG ReadTime;
+	LONGLONG DecodeTime;
 } DETECTED_OBJECTS;
 
 typedef struct _BUTTON_CACHE
@@ -75,6 +110,414 @@ typedef struct _BUTTON_CACHE
 	BOOLEAN ButtonSlots[MAX_BUTTONS];
 } BUTTON_CACHE;
 
+//
+// Reports waiting for HIDClass to post a read request. Reports are only
+// produced from the interrupt service path, so the ring has a single
+// producer; completion is done by whoever holds the Draining flag.
+//
+#define REPORT_RING_SIZE 16
+
+typedef enum _REPORT_RING_ENTRY_STATE
+{
+	REPORT_RING_ENTRY_FREE = 0,
+	REPORT_RING_ENTRY_READY = 1,
+	REPORT_RING_ENTRY_CLAIMED = 2,
+	REPORT_RING_ENTRY_UPDATING = 3
+} REPORT_RING_ENTRY_STATE;
+
+typedef struct _REPORT_RING_ENTRY
+{
+	volatile LONG State;
+	ULONG Length;
+	HID_INPUT_REPORT Report;
+
+	//
+	// Interrupt and decode time of the frame the report was built from,
+	// zero for frames that were not read in response to an interrupt
+	//
+	LONGLONG InterruptTime;
+	LONGLONG DecodeTime;
+} REPORT_RING_ENTRY;
+
+typedef struct _REPORT_RING
+{
+	REPORT_RING_ENTRY Entries[REPORT_RING_SIZE];
+	volatile LONG Head;
+	volatile LONG Tail;
+	volatile LONG Draining;
+	volatile LONG DrainRequests;
+
+	//
+	// Flushes requested, and the last one the drainer carried out. Pending
+	// reports are discarded instead of completed while they differ
+	//
+	volatile LONG FlushRequests;
+	LONG FlushesDone;
+
+	//
+	// Statistics
+	//
+	ULONG Dropped;
+	ULONG Coalesced;
+	ULONG MaxDepth;
+} REPORT_RING;
+
+//
+// Hot path trace. Records below REPORT_TRACE_LEVEL (a TRACE_LEVEL_XXX value)
+// are compiled out, 0 removes the trace ring and its feature report
+// altogether. Records are written into a per-device ring by any number of
+// writers without locking and read back through the REPORTID_TRACE feature
+// report, each read returning the records following the previous read.
+//
+#ifndef REPORT_TRACE_LEVEL
+#if DBG
+#define REPORT_TRACE_LEVEL 5 // TRACE_LEVEL_VERBOSE
+#else
+#define REPORT_TRACE_LEVEL 4 // TRACE_LEVEL_INFORMATION
+#endif
+#endif
+
+#define REPORT_TRACE_RING_SIZE 256
+#define REPORT_TRACE_RECORDS_PER_REPORT 16
+
+typedef enum _REPORT_TRACE_EVENT
+{
+	REPORT_TRACE_EVENT_NONE = 0,
+
+	//
+	// ISR entry, no arguments
+	//
+	REPORT_TRACE_EVENT_INTERRUPT = 1,
+
+	//
+	// Frame read from the controller. Arg0 is the lifted slot mask, Arg1
+	// the performance counter ticks since the interrupt, Arg2 the status
+	//
+	REPORT_TRACE_EVENT_FRAME = 2,
+
+	//
+	// Report handed to HIDClass. Arg0 is the report ID in the low byte and
+	// the contact count in the high byte, Arg1 the length, Arg2 the status
+	//
+	REPORT_TRACE_EVENT_REPORT_SENT = 3,
+
+	//
+	// Frame passed through continuous reporting. Arg1 is the measured scan
+	// period in performance counter ticks, Arg2 the status
+	//
+	REPORT_TRACE_EVENT_CONTINUOUS_FRAME = 4,
+
+	//
+	// Last frame republished by the continuous reporting timer. Arg1 is the
+	// period in milliseconds, Arg2 the status
+	//
+	REPORT_TRACE_EVENT_CONTINUOUS_RESEND = 5
+} REPORT_TRACE_EVENT;
+
+//
+// Both structures are laid out without padding, they go on the wire as is
+//
+typedef struct _REPORT_TRACE_RECORD
+{
+	//
+	// Performance counter value the record was written at
+	//
+	LONGLONG Timestamp;
+
+	//
+	// Position of the record in the trace, counting from 1. A record that
+	// was being overwritten while it was read back has a sequence of 0
+	//
+	ULONG Sequence;
+	USHORT Event;
+	USHORT Arg0;
+	ULONG Arg1;
+	ULONG Arg2;
+} REPORT_TRACE_RECORD;
+
+// REPORTID_TRACE
+typedef struct _REPORT_TRACE_FEATURE_REPORT
+{
+	UCHAR ReportID;
+	UCHAR Count;
+
+	//
+	// Records overwritten before they could be read, saturating
+	//
+	USHORT Lost;
+
+	//
+	// Records written since the device started
+	//
+	ULONG Written;
+	LONGLONG Frequency;
+	REPORT_TRACE_RECORD Records[REPORT_TRACE_RECORDS_PER_REPORT];
+} REPORT_TRACE_FEATURE_REPORT, * PREPORT_TRACE_FEATURE_REPORT;
+
+C_ASSERT(sizeof(REPORT_TRACE_RECORD) == 24);
+C_ASSERT(FIELD_OFFSET(REPORT_TRACE_FEATURE_REPORT, Records) == 16);
+C_ASSERT((REPORT_TRACE_RING_SIZE & (REPORT_TRACE_RING_SIZE - 1)) == 0);
+
+typedef struct _REPORT_TRACE
+{
+	volatile LONG Written;
+	volatile LONG ReadCursor;
+	REPORT_TRACE_RECORD Records[REPORT_TRACE_RING_SIZE];
+} REPORT_TRACE;
+
+#if REPORT_TRACE_LEVEL >= 4
+#define ReportTraceInformation(ReportContext, Event, Arg0, Arg1, Arg2) \
+	ReportTraceWrite(&(ReportContext)->Trace, Event, Arg0, Arg1, Arg2)
+#else
+#define ReportTraceInformation(ReportContext, Event, Arg0, Arg1, Arg2)
+#endif
+
+#if REPORT_TRACE_LEVEL >= 5
+#define ReportTraceVerbose(ReportContext, Event, Arg0, Arg1, Arg2) \
+	ReportTraceWrite(&(ReportContext)->Trace, Event, Arg0, Arg1, Arg2)
+#else
+#define ReportTraceVerbose(ReportContext, Event, Arg0, Arg1, Arg2)
+#endif
+
+//
+// Latency of the interrupt service path, from the interrupt to the
+// completion of the HIDClass read request carrying the frame. Each stage
+// keeps a histogram with log2 microsecond buckets: bucket n counts samples
+// below 2^(n+1) us, the last bucket everything above. Read back through the
+// REPORTID_LATENCY feature report, P99Us is only filled in there and is the
+// upper bound of the bucket holding the 99th percentile.
+//
+#define REPORT_LATENCY_BUCKETS 20
+
+typedef enum _REPORT_LATENCY_STAGE_ID
+{
+	//
+	// Interrupt to touch frame read from the controller
+	//
+	REPORT_LATENCY_STAGE_READ = 0,
+
+	//
+	// Frame read to frame decoded
+	//
+	REPORT_LATENCY_STAGE_DECODE = 1,
+
+	//
+	// Frame decoded to report completed to HIDClass, includes the time
+	// spent waiting for a read request
+	//
+	REPORT_LATENCY_STAGE_COMPLETE = 2,
+
+	//
+	// Interrupt to report completed to HIDClass
+	//
+	REPORT_LATENCY_STAGE_TOTAL = 3,
+
+	REPORT_LATENCY_STAGES = 4
+} REPORT_LATENCY_STAGE_ID;
+
+typedef struct _REPORT_LATENCY_STAGE
+{
+	ULONG Count;
+	ULONG MinUs;
+	ULONG MaxUs;
+	ULONG P99Us;
+	ULONG Buckets[REPORT_LATENCY_BUCKETS];
+} REPORT_LATENCY_STAGE;
+
+// REPORTID_LATENCY
+typedef struct _REPORT_LATENCY_FEATURE_REPORT
+{
+	UCHAR ReportID;
+	UCHAR StageCount;
+	USHORT BucketCount;
+	REPORT_LATENCY_STAGE Stages[REPORT_LATENCY_STAGES];
+} REPORT_LATENCY_FEATURE_REPORT, * PREPORT_LATENCY_FEATURE_REPORT;
+
+C_ASSERT(FIELD_OFFSET(REPORT_LATENCY_FEATURE_REPORT, Stages) == 4);
+
+typedef struct _REPORT_LATENCY
+{
+	REPORT_LATENCY_STAGE Stages[REPORT_LATENCY_STAGES];
+
+	//
+	// Set while the interrupt service path reports a frame, copied into
+	// the ring entries of its reports
+	//
+	LONGLONG FrameInterruptTime;
+	LONGLONG FrameDecodeTime;
+	LONGLONG Frequency;
+} REPORT_LATENCY;
+
+//
+// Continuous reporting simulation for controllers that only interrupt when
+// contacts move. The last frame is republished by a timer that follows the
+// measured scan rate; the snapshot is written by the ISR under a sequence
+// count (odd while an update is in progress) so the timer can tell without
+// locking whether a real frame superseded it.
+//
+#define REPORT_CONTINUOUS_MIN_PERIOD_MS 8
+#define REPORT_CONTINUOUS_MAX_PERIOD_MS 50
+
+typedef struct _REPORT_CONTINUOUS
+{
+	WDFTIMER Timer;
+	WDFINTERRUPT Interrupt;
+
+	volatile LONG Sequence;
+	DETECTED_OBJECTS Frame;
+	LONGLONG LastFrameTime;
+
+	//
+	// Running average of the interval between real frames, in performance
+	// counter ticks. Zero until two frames arrived close enough together
+	//
+	LONGLONG ScanPeriod;
+	LONGLONG Frequency;
+
+	//
+	// Set while the device is out of D0. Neither a late frame nor the timer
+	// callback re-arms the timer then
+	//
+	BOOLEAN Stopped;
+
+	//
+	// Statistics
+	//
+	ULONG Resent;
+	ULONG Suppressed;
+} REPORT_CONTINUOUS;
+
+//
+// Optional suppression of finger reports that repeat the last one sent.
+// Contacts within the thresholds (display pixels) of their last reported
+// position count as unchanged; a report is still sent every keep-alive
+// interval
+//
+typedef struct _REPORT_SUPPRESSION
+{
+	BOOLEAN Enabled;
+	USHORT ThresholdX;
+	USHORT ThresholdY;
+	LONGLONG KeepAlive;
+
+	HID_TOUCH_REPORT LastReport;
+	LONGLONG LastReportTime;
+
+	//
+	// Statistics
+	//
+	ULONG Suppressed;
+} REPORT_SUPPRESSION;
+
+//
+// Per-slot 1 euro filter on the cached positions. Positions and speeds are
+// kept in 1/256 pixel units, cutoffs in millihertz
+//
+#define REPORT_FILTER_DERIVATIVE_CUTOFF 1000UL
+#define REPORT_FILTER_MAX_CUTOFF        100000UL
+#define REPORT_FILTER_MAX_INTERVAL_US   100000UL
+
+typedef struct _REPORT_FILTER_SLOT
+{
+	LONGLONG X;
+	LONGLONG Y;
+	LONGLONG SpeedX;
+	LONGLONG SpeedY;
+} REPORT_FILTER_SLOT;
+
+typedef struct _REPORT_FILTER
+{
+	BOOLEAN Enabled;
+	ULONG MinCutoff;
+	ULONG Beta;
+	LONGLONG Frequency;
+
+	//
+	// Slots with filter state, anything else is reset to the raw position
+	// when it is next seen
+	//
+	UINT32 SlotValid;
+	LONGLONG LastTimestamp;
+	REPORT_FILTER_SLOT Slot[MAX_TOUCHES];
+} REPORT_FILTER;
+
+//
+// Per-slot position predictor extrapolating contacts along their velocity
+// and acceleration to hide display latency. Positions are in 1/256 pixel
+// units, speeds per second
+//
+#define REPORT_PREDICTOR_MAX_HORIZON_MS  100UL
+#define REPORT_PREDICTOR_MIN_INTERVAL_US 1000UL
+
+typedef struct _REPORT_PREDICTOR_SLOT
+{
+	LONGLONG X;
+	LONGLONG Y;
+	LONGLONG VelocityX;
+	LONGLONG VelocityY;
+	LONGLONG AccelerationX;
+	LONGLONG AccelerationY;
+	ULONG Samples;
+} REPORT_PREDICTOR_SLOT;
+
+typedef struct _REPORT_PREDICTOR
+{
+	BOOLEAN Enabled;
+	ULONG HorizonUs;
+	LONGLONG MaxDistance;
+	ULONG VelocityGain;
+	ULONG AccelerationGain;
+	LONGLONG Frequency;
+
+	UINT32 SlotValid;
+	LONGLONG LastTimestamp;
+	REPORT_PREDICTOR_SLOT Slot[MAX_TOUCHES];
+} REPORT_PREDICTOR;
+
+//
+// Palm and large-blob rejection from the contact area (0-15) and pressure
+// reported by the controller. A contact turns into a palm as soon as it
+// reaches the threshold; it only turns back into a finger after staying
+// below the release level for a few frames, and never while the host sees
+// it with the confidence bit cleared.
+//
+#define REPORT_PALM_OFF              0
+#define REPORT_PALM_CLEAR_CONFIDENCE 1
+#define REPORT_PALM_SUPPRESS         2
+
+#define REPORT_PALM_AREA_HYSTERESIS  2UL
+#define REPORT_PALM_RELEASE_FRAMES   4UL
+
+typedef struct _REPORT_PALM
+{
+	ULONG Mode;
+	UCHAR AreaThreshold;
+	UCHAR AreaRelease;
+	UCHAR WeightThreshold;
+	UCHAR WeightRelease;
+
+	//
+	// Slots classified as palms, and slots the host currently sees as down
+	//
+	UINT32 SlotValid;
+	UINT32 Palm;
+	UINT32 Reported;
+	UCHAR ReleaseFrames[MAX_TOUCHES];
+
+	//
+	// Outcome for the current frame: slots left out of the finger report,
+	// reported without confidence, and reported lifted although still down
+	//
+	UINT32 Hidden;
+	UINT32 NoConfidence;
+	UINT32 Cancelled;
+
+	//
+	// Statistics
+	//
+	ULONG Rejected;
+} REPORT_PALM;
+
 typedef struct _REPORT_CONTEXT
 {
 	BUTTON_CACHE ButtonCache;
@@ -82,8 +525,86 @@ typedef struct _REPORT_CONTEXT
 	OBJECT_CACHE Cache;
 	TOUCH_SCREEN_PROPERTIES Props;
 	WDFQUEUE PingPongQueue;
+	REPORT_RING PendingReports;
+	REPORT_CONTINUOUS Continuous;
+	REPORT_SUPPRESSION Suppression;
+	REPORT_FILTER Filter;
+	REPORT_PREDICTOR Predictor;
+	REPORT_PALM Palm;
+	REPORT_LATENCY Latency;
+
+	//
+	// Finger report layout, matching the report descriptor: contacts per
+	// report (hybrid mode below MAX_TOUCHES), whether each contact carries
+	// width, height and pressure, and the resulting lengths
+	//
+	BOOLEAN ContactSize;
+	ULONG ContactsPerReport;
+	ULONG FingerContactLength;
+	ULONG FingerReportLength;
+
+	//
+	// Set by the ISR when the interrupt asserts, consumed by the frame read
+	// that services it
+	//
+	LARGE_INTEGER InterruptTimestamp;
+
+#if REPORT_TRACE_LEVEL > 0
+	REPORT_TRACE Trace;
+#endif
 } REPORT_CONTEXT, * PREPORT_CONTEXT;
 
+VOID
+ReportLatencyRecord(
+	IN PREPORT_CONTEXT ReportContext,
+	IN REPORT_LATENCY_STAGE_ID Stage,
+	IN LONGLONG Ticks
+);
+
+VOID
+ReportLatencyRead(
+	IN PREPORT_CONTEXT ReportContext,
+	OUT PREPORT_LATENCY_FEATURE_REPORT Report
+);
+
+#if REPORT_TRACE_LEVEL > 0
+VOID
+ReportTraceWrite(
+	IN REPORT_TRACE* Trace,
+	IN USHORT Event,
+	IN USHORT Arg0,
+	IN ULONG Arg1,
+	IN ULONG Arg2
+);
+
+VOID
+ReportTraceRead(
+	IN PREPORT_CONTEXT ReportContext,
+	OUT PREPORT_TRACE_FEATURE_REPORT Report
+);
+#endif
+
+NTSTATUS
+ReportQueueHidReport(
+	IN PREPORT_CONTEXT ReportContext,
+	IN PHID_INPUT_REPORT HidReport
+);
+
+VOID
+ReportDrainPendingReports(
+	IN PREPORT_CONTEXT ReportContext
+);
+
+VOID
+ReportFlushPendingReports(
+	IN PREPORT_CONTEXT ReportContext
+);
+
+VOID
+ReportResetContactState(
+	IN PREPORT_CONTEXT ReportContext
+);
+
 NTSTATUS
 ReportWakeup(
 	IN PREPORT_CONTEXT ReportContext
@@ -120,5 +641,56 @@ ReportObjects(
 
 NTSTATUS
 ReportConfigureContinuousSimulationTimer(
-	IN WDFDEVICE DeviceHandle
+	IN PREPORT_CONTEXT ReportContext,
+	IN WDFDEVICE DeviceHandle,
+	IN WDFINTERRUPT Interrupt
+);
+
+VOID
+ReportConfigureSuppression(
+	IN PREPORT_CONTEXT ReportContext,
+	IN BOOLEAN Enabled,
+	IN UINT32 ThresholdX,
+	IN UINT32 ThresholdY,
+	IN UINT32 KeepAliveMs
+);
+
+VOID
+ReportConfigureFilter(
+	IN PREPORT_CONTEXT ReportContext,
+	IN UINT32 AbsPosFilt
+);
+
+VOID
+ReportConfigurePredictor(
+	IN PREPORT_CONTEXT ReportContext,
+	IN UINT32 HorizonMs,
+	IN UINT32 MaxDistance,
+	IN UINT32 VelocityGain,
+	IN UINT32 AccelerationGain
+);
+
+VOID
+ReportConfigurePalmRejection(
+	IN PREPORT_CONTEXT ReportContext,
+	IN UINT32 Mode,
+	IN UINT32 AreaThreshold,
+	IN UINT32 WeightThreshold
+);
+
+VOID
+ReportConfigureFingerReports(
+	IN PREPORT_CONTEXT ReportContext,
+	IN BOOLEAN ContactSize,
+	IN UINT32 ContactsPerReport
+);
+
+VOID
+ReportStartContinuousSimulation(
+	IN PREPORT_CONTEXT ReportContext
+);
+
+VOID
+ReportStopContinuousSimulation(
+	IN PREPORT_CONTEXT ReportContext
 );
\ No newline at end of file
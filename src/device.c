@@ -70,14 +70,17 @@ OnInterruptIsr(
 
     UNREFERENCED_PARAMETER(MessageID);
 
-    Trace(
-        TRACE_LEVEL_ERROR,
-        TRACE_REPORTING,
-        "OnInterruptIsr - Entry");
-
     status = STATUS_SUCCESS;
     devContext = GetDeviceContext(WdfInterruptGetDevice(Interrupt));
 
+    //
+    // Timestamp the frame as early as possible, the touch stack derives
+    // velocity from the scan time
+    //
+    devContext->ReportContext.InterruptTimestamp = KeQueryPerformanceCounter(NULL);
+
+    ReportTraceVerbose(&devContext->ReportContext, REPORT_TRACE_EVENT_INTERRUPT, 0, 0, 0);
+
     //
     // For performance tracing, write an ETW event marker
     //
@@ -154,6 +157,8 @@ Return Value:
             status);
     }
 
+    ReportStartContinuousSimulation(&devContext->ReportContext);
+
     //
     // N.B. This FT5X chip's IRQ is level-triggered, but cannot be enabled in
     //      ACPI until passive-level interrupt handling is added to the driver.
@@ -314,6 +319,7 @@ OnPrepareHardware(
     NTSTATUS status;
     PCM_PARTIAL_RESOURCE_DESCRIPTOR res;
     PDEVICE_EXTENSION devContext;
+    FT5X_CONTROLLER_CONTEXT* controller;
     ULONG resourceCount;
     ULONG i;
     LARGE_INTEGER delay;
@@ -475,10 +481,61 @@ OnPrepareHardware(
         goto exit;
     }
 
+    controller = (FT5X_CONTROLLER_CONTEXT*)devContext->TouchContext;
+
+    ReportConfigureSuppression(
+        &devContext->ReportContext,
+        controller->Config.SuppressStationaryReports != 0,
+        controller->Config.TouchSettings.DeltaXPosThreshold,
+        controller->Config.TouchSettings.DeltaYPosThreshold,
+        controller->Config.StationaryKeepAliveMs);
+
+    ReportConfigureFilter(
+        &devContext->ReportContext,
+        controller->Config.TouchSettings.AbsPosFilt);
+
+    ReportConfigurePredictor(
+        &devContext->ReportContext,
+        controller->Config.PredictionHorizonMs,
+        controller->Config.PredictionMaxDistance,
+        controller->Config.TouchSettings.Velocity,
+        controller->Config.TouchSettings.Acceleration);
+
+    ReportConfigurePalmRejection(
+        &devContext->ReportContext,
+        controller->Config.PalmRejection,
+        controller->Config.TouchSettings.PalmDetectThreshold,
+        controller->Config.PalmWeightThreshold);
+
+    ReportConfigureFingerReports(
+        &devContext->ReportContext,
+        controller->Config.ReportContactSize != 0,
+        controller->Config.ContactsPerReport);
+
+    //
+    // The report layout and screen properties are known now, generate the
+    // report descriptor once rather than on every request for it
+    //
+    status = TchBuildReportDescriptor(FxDevice);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error generating report descriptor - 0x%08lX",
+            status);
+
+        goto exit;
+    }
+
     //
     // Configure the timer for continuous simulation on synaptics hardware that doesn't support it
     //
-    status = ReportConfigureContinuousSimulationTimer(devContext->FxDevice);
+    status = ReportConfigureContinuousSimulationTimer(
+        &devContext->ReportContext,
+        devContext->FxDevice,
+        devContext->InterruptObject);
 
     if (!NT_SUCCESS(status))
     {
@@ -1,64 +1,75 @@
 #include "_spb.h"
 #include "internal.h"
 #include "trace.h"
+#include <ft5x/ftinternal.h>
 #include <ft5x/ftfwupdate.h>
 #include <ftfwupdate.tmh>
 
-NTSTATUS DPramWrite(IN SPB_CONTEXT* SpbContext, UINT8* buf, UINT32 len, BOOLEAN wpram) {
-	NTSTATUS status = STATUS_SUCCESS;
-	UINT8* Cmd = NULL;
-	UINT32 Addr = 0;
-	UINT32 BaseAddr = wpram ? FTS_PRAM_SADDR : FTS_DRAM_SADDR;
-	UINT32 Offset = 0;
-	UINT32 Remainder;
-	UINT32 PacketNumber = 0;
-	UINT32 PacketLen = 0;
-	UINT32 PacketSize = FTS_FLASH_PACKET_LENGTH_SPI;
-
-	Cmd = ExAllocatePool2(POOL_FLAG_NON_PAGED, PacketSize + 7, TOUCH_POOL_TAG);
+#if FTS_ECC_USE_TABLE
+//
+// Lookup tables for the host ECC polynomial. Table 0 folds one byte into the
+// remainder, tables 1..3 additionally advance it over 1..3 trailing zero
+// bytes so two 16-bit words can be consumed per iteration.
+//
+static UINT16 gEccTable[4][256];
+static BOOLEAN gEccTableReady = FALSE;
 
-	PacketNumber = len / PacketSize;
-	Remainder = len % PacketSize;
-	if (Remainder > 0)
-		PacketNumber++;
-	PacketLen = PacketSize;
-	Trace(TRACE_LEVEL_INFORMATION, TRACE_FTFWUPDATE, "Write data, num: %d remainder: %d", PacketNumber, Remainder);
-	for (UINT32 i = 0; i < PacketNumber; i++) {
-		Offset = i * PacketSize;
-		Addr = Offset + BaseAddr;
-		if ((i == (PacketNumber - 1)) && Remainder)
-			PacketLen = Remainder;
+static void FTSEccInitTable(void)
+{
+	UINT16 al2_fcs_coef = ((1 << 15) + (1 << 10) + (1 << 3));
+	UINT16 ecc;
+	UINT32 i;
+	UINT32 j;
 
-		Cmd[0] = FTS_ROMBOOT_CMD_SET_PRAM_ADDR;
-		Cmd[1] = (UINT8)(((Addr) >> 16) & 0xFF);
-		Cmd[2] = (UINT8)(((Addr) >> 8) & 0xFF);
-		Cmd[3] = (UINT8)((Addr) & 0xFF);
-		status = FTS_Write(SpbContext, &Cmd[0], FTS_ROMBOOT_CMD_SET_PRAM_ADDR_LEN);
-		if (!NT_SUCCESS(status)) {
-			Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Failed to set pram addr %!STATUS!", status);
-			goto exit;
-		}
+	if (gEccTableReady)
+		return;
 
-		Cmd[0] = FTS_ROMBOOT_CMD_WRITE;
-		for (UINT32 j = 0; j < PacketLen; j++) {
-			Cmd[1 + j] = buf[Offset + j];
+	for (i = 0; i < 256; i++) {
+		ecc = (UINT16)i;
+		for (j = 0; j < 8; j++) {
+			if (ecc & 0x01)
+				ecc = (UINT16)((ecc >> 1) ^ al2_fcs_coef);
+			else
+				ecc >>= 1;
 		}
+		gEccTable[0][i] = ecc;
+	}
 
-		status = FTS_Write(SpbContext, &Cmd[0], 1 + PacketLen);
-		if (!NT_SUCCESS(status)) {
-			Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Failed to write fw to pram %!STATUS!", status);
-			goto exit;
+	for (j = 1; j < 4; j++) {
+		for (i = 0; i < 256; i++) {
+			ecc = gEccTable[j - 1][i];
+			gEccTable[j][i] = (UINT16)((ecc >> 8) ^ gEccTable[0][ecc & 0xFF]);
 		}
 	}
-exit:
-	ExFreePoolWithTag(Cmd, TOUCH_POOL_TAG);
-	return status;
+
+	gEccTableReady = TRUE;
 }
+#endif
 
 void FTSEccCalHost(UINT8* data, UINT32 dataLen, UINT16* eccValue)
 {
 	UINT16 ecc = 0;
-	UINT16 i = 0;
+	UINT32 i = 0;
+#if FTS_ECC_USE_TABLE
+	FTSEccInitTable();
+
+	//
+	// Each 16-bit word is XORed in big-endian order and then shifted out
+	// LSB first, so the low byte of the word is consumed before the high one
+	//
+	for (; i + 4 <= dataLen; i += 4) {
+		ecc ^= (UINT16)((data[i] << 8) | data[i + 1]);
+		ecc = (UINT16)(gEccTable[3][ecc & 0xFF] ^
+			gEccTable[2][ecc >> 8] ^
+			gEccTable[1][data[i + 3]] ^
+			gEccTable[0][data[i + 2]]);
+	}
+
+	for (; i < dataLen; i += 2) {
+		ecc ^= (UINT16)((data[i] << 8) | data[i + 1]);
+		ecc = (UINT16)(gEccTable[1][ecc & 0xFF] ^ gEccTable[0][ecc >> 8]);
+	}
+#else
 	UINT16 j = 0;
 	UINT16 al2_fcs_coef = ((1 << 15) + (1 << 10) + (1 << 3));
 
@@ -71,17 +82,15 @@ void FTSEccCalHost(UINT8* data, UINT32 dataLen, UINT16* eccValue)
 				ecc >>= 1;
 		}
 	}
+#endif
 
 	*eccValue = ecc & 0x0000FFFF;
 }
 
-NTSTATUS FTSEccCalTP(IN SPB_CONTEXT* SpbContext, UINT32 eccAddr, UINT32 eccLen, UINT16* eccValue)
+NTSTATUS FTSEccStartTP(IN SPB_CONTEXT* SpbContext, UINT32 eccAddr, UINT32 eccLen)
 {
 	NTSTATUS status = STATUS_SUCCESS;
-	LARGE_INTEGER delay;
-	int i;
 	UINT8 cmd[7] = { 0 };
-	UINT8 value[2] = { 0 };
 
 	cmd[0] = 0xCC;
 	cmd[1] = (UINT8)(((eccAddr) >> 16) & 0xFF);
@@ -94,10 +103,18 @@ NTSTATUS FTSEccCalTP(IN SPB_CONTEXT* SpbContext, UINT32 eccAddr, UINT32 eccLen,
 	status = FTS_Write(SpbContext, cmd, 7);
 	if (!NT_SUCCESS(status)) {
 		Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "ecc calc cmd fail %!STATUS!", status);
-		goto exit;
 	}
-	delay.QuadPart = 2000;
-	KeDelayExecutionThread(KernelMode, TRUE, &delay);
+
+	return status;
+}
+
+NTSTATUS FTSEccReadTP(IN SPB_CONTEXT* SpbContext, UINT16* eccValue)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	LARGE_INTEGER delay;
+	int i;
+	UINT8 cmd[1] = { 0 };
+	UINT8 value[2] = { 0 };
 
 	cmd[0] = 0xCE;
 	for (i = 0; i < 100; i++) {
@@ -108,7 +125,7 @@ NTSTATUS FTSEccCalTP(IN SPB_CONTEXT* SpbContext, UINT32 eccAddr, UINT32 eccLen,
 		}
 		if (value[0] == 0xA5)
 			break;
-		delay.QuadPart = 1000;
+		delay.QuadPart = -10000LL * 1;
 		KeDelayExecutionThread(KernelMode, TRUE, &delay);
 	}
 	if (i >= 100) {
@@ -129,30 +146,61 @@ exit:
 	return status;
 }
 
-NTSTATUS FTSEccCheck(IN SPB_CONTEXT* SpbContext, UINT8* buf, UINT32 len, UINT32 eccAddr)
-{
+NTSTATUS DPramWrite(IN SPB_CONTEXT* SpbContext, UINT8* buf, UINT32 len, BOOLEAN wpram, UINT32 eccAddr) {
 	NTSTATUS status = STATUS_SUCCESS;
-	UINT32 packetSize = 32766;
+	UINT8 Cmd[FTS_ROMBOOT_CMD_SET_PRAM_ADDR_LEN];
+	UINT32 Addr = 0;
+	UINT32 BaseAddr = wpram ? FTS_PRAM_SADDR : FTS_DRAM_SADDR;
+	UINT32 Offset = 0;
+	UINT32 Remainder;
+	UINT32 PacketNumber = 0;
+	UINT32 PacketLen = 0;
+	UINT32 PacketSize = FTS_FLASH_PACKET_LENGTH_SPI;
 	UINT16 eccHost = 0;
 	UINT16 eccTp = 0;
-	int offset = 0;
-	int packetNumber = 0;
-	int packetRemainder = 0;
-	int packetLength;
 
-	packetNumber = len / packetSize;
-	packetRemainder = len % packetSize;
-	if (packetRemainder)
-		packetNumber++;
-	packetLength = packetSize;
+	PacketNumber = len / PacketSize;
+	Remainder = len % PacketSize;
+	if (Remainder > 0)
+		PacketNumber++;
+	PacketLen = PacketSize;
+	Trace(TRACE_LEVEL_INFORMATION, TRACE_FTFWUPDATE, "Write data, num: %d remainder: %d", PacketNumber, Remainder);
+	for (UINT32 i = 0; i < PacketNumber; i++) {
+		Offset = i * PacketSize;
+		Addr = Offset + BaseAddr;
+		if ((i == (PacketNumber - 1)) && Remainder)
+			PacketLen = Remainder;
+
+		Cmd[0] = FTS_ROMBOOT_CMD_SET_PRAM_ADDR;
+		Cmd[1] = (UINT8)(((Addr) >> 16) & 0xFF);
+		Cmd[2] = (UINT8)(((Addr) >> 8) & 0xFF);
+		Cmd[3] = (UINT8)((Addr) & 0xFF);
+		status = FTS_Write(SpbContext, &Cmd[0], FTS_ROMBOOT_CMD_SET_PRAM_ADDR_LEN);
+		if (!NT_SUCCESS(status)) {
+			Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Failed to set pram addr %!STATUS!", status);
+			goto exit;
+		}
+
+		status = FTS_WriteGather(SpbContext, FTS_ROMBOOT_CMD_WRITE, buf + Offset, PacketLen);
+		if (!NT_SUCCESS(status)) {
+			Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Failed to write fw to pram %!STATUS!", status);
+			goto exit;
+		}
 
-	for (int i = 0; i < packetNumber; i++) {
-		if ((i == (packetNumber - 1)) && packetRemainder)
-			packetLength = packetRemainder;
+		//
+		// Verify the packet as soon as it landed: kick off the controller
+		// side ECC first and compute the host side ECC while the controller
+		// is busy, instead of a second pass over the whole image.
+		//
+		status = FTSEccStartTP(SpbContext, eccAddr + Offset, PacketLen);
+		if (!NT_SUCCESS(status)) {
+			Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "failed to start ecc on tp %!STATUS!", status);
+			goto exit;
+		}
 
-		FTSEccCalHost(buf + offset, packetLength, &eccHost);
+		FTSEccCalHost(buf + Offset, PacketLen, &eccHost);
 
-		status = FTSEccCalTP(SpbContext, eccAddr + offset, packetLength, &eccTp);
+		status = FTSEccReadTP(SpbContext, &eccTp);
 		if (!NT_SUCCESS(status)) {
 			Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "failed to get ecc from tp %!STATUS!", status);
 			goto exit;
@@ -164,8 +212,6 @@ NTSTATUS FTSEccCheck(IN SPB_CONTEXT* SpbContext, UINT8* buf, UINT32 len, UINT32
 			status = STATUS_IO_DEVICE_ERROR;
 			goto exit;
 		}
-
-		offset += packetLength;
 	}
 exit:
 	return status;
@@ -184,20 +230,13 @@ NTSTATUS FTSPramWriteEcc(SPB_CONTEXT* SpbContext, UINT8* buf) {
 		goto exit;
 	}
 
-	status = DPramWrite(SpbContext, buf, CodeLen * 2, TRUE);
+	status = DPramWrite(SpbContext, buf, CodeLen * 2, TRUE, 0);
 	if (!NT_SUCCESS(status)) {
 		Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Pram write failed %!STATUS!", status);
 		status = STATUS_DATA_ERROR;
 		goto exit;
 	}
 
-	status = FTSEccCheck(SpbContext, buf, CodeLen * 2, 0);
-	if (!NT_SUCCESS(status)) {
-		Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Failed to calc pram crc %!STATUS!", status);
-		goto exit;
-	}
-	//TODO: Add a crc check
-
 exit:
 	return status;
 }
@@ -218,22 +257,130 @@ NTSTATUS FTSDramWriteEcc(SPB_CONTEXT* SpbContext, UINT8* buf) {
 
 	PramAppSize = ((UINT32)(((UINT16)buf[FTS_APP_INFO_OFFSET + 0] << 8) + buf[FTS_APP_INFO_OFFSET + 1])) * 2;
 
-	status = DPramWrite(SpbContext, buf + PramAppSize, CodeLen * 2, FALSE);
+	status = DPramWrite(SpbContext, buf + PramAppSize, CodeLen * 2, FALSE, 0);
 	if (!NT_SUCCESS(status)) {
 		Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Dram write failed %!STATUS!", status);
 		status = STATUS_DATA_ERROR;
 		goto exit;
 	}
 
-	status = FTSEccCheck(SpbContext, buf + PramAppSize, CodeLen * 2, 0);
+exit:
+	return status;
+}
+
+NTSTATUS FTSWaitAppReady(SPB_CONTEXT* SpbContext, UINT8* fwVersion) {
+	NTSTATUS status;
+	UINT8 cmd = FTS_REG_FW_VER;
+	UINT8 version = 0;
+	UINT32 pollMs = FTS_APP_READY_POLL_MIN_MS;
+	ULONGLONG start = KeQueryInterruptTime();
+	ULONGLONG elapsedMs = 0;
+	LARGE_INTEGER Interval;
+
+	*fwVersion = 0;
+
+	//
+	// The boot loader does not answer application registers, so the first
+	// valid firmware version read tells us the application is up
+	//
+	for (;;) {
+		Interval.QuadPart = -10000LL * pollMs;
+		KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+
+		elapsedMs = (KeQueryInterruptTime() - start) / 10000;
+
+		status = FTS_Read(SpbContext, &cmd, &version, 1);
+		if (NT_SUCCESS(status) && version != 0 && version != 0xFF) {
+			break;
+		}
+
+		if (elapsedMs >= FTS_APP_READY_TIMEOUT_MS) {
+			Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Firmware not ready after %llu ms", elapsedMs);
+			return STATUS_IO_TIMEOUT;
+		}
+
+		pollMs = min(pollMs * 2, FTS_APP_READY_POLL_MAX_MS);
+	}
+
+	*fwVersion = version;
+
+	Trace(TRACE_LEVEL_INFORMATION, TRACE_FTFWUPDATE, "Firmware 0x%X ready after %llu ms", version, elapsedMs);
+	return STATUS_SUCCESS;
+}
+
+//
+// The version that came up after our last download and the identity of the
+// image it came from are kept in the device's hardware key, so a driver
+// restart that leaves the controller running can still skip the download.
+// A skip needs both the controller to answer with that version, which the
+// boot loader never does after a power cycle, and the image on disk to be
+// the one that was downloaded
+//
+static VOID FTSQueryDeviceValue(WDFDEVICE Device, PCWSTR Name, ULONG* Value) {
+	NTSTATUS status;
+	WDFKEY hKey = NULL;
+	UNICODE_STRING valueName;
+
+	*Value = 0;
+
+	status = WdfDeviceOpenRegistryKey(Device, PLUGPLAY_REGKEY_DEVICE, KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &hKey);
+	if (!NT_SUCCESS(status)) {
+		return;
+	}
+
+	RtlInitUnicodeString(&valueName, Name);
+
+	status = WdfRegistryQueryULong(hKey, &valueName, Value);
 	if (!NT_SUCCESS(status)) {
-		Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Failed to calc dram crc %!STATUS!", status);
-		goto exit;
+		*Value = 0;
 	}
-	//TODO: Add a crc check
 
-exit:
-	return status;
+	WdfRegistryClose(hKey);
+}
+
+static VOID FTSSaveDeviceValue(WDFDEVICE Device, PCWSTR Name, ULONG Value) {
+	NTSTATUS status;
+	WDFKEY hKey = NULL;
+	UNICODE_STRING valueName;
+
+	status = WdfDeviceOpenRegistryKey(Device, PLUGPLAY_REGKEY_DEVICE, KEY_WRITE, WDF_NO_OBJECT_ATTRIBUTES, &hKey);
+	if (!NT_SUCCESS(status)) {
+		Trace(TRACE_LEVEL_WARNING, TRACE_FTFWUPDATE, "Failed to open device key to save %ws %!STATUS!", Name, status);
+		return;
+	}
+
+	RtlInitUnicodeString(&valueName, Name);
+
+	status = WdfRegistryAssignULong(hKey, &valueName, Value);
+	if (!NT_SUCCESS(status)) {
+		Trace(TRACE_LEVEL_WARNING, TRACE_FTFWUPDATE, "Failed to save %ws %!STATUS!", Name, status);
+	}
+
+	WdfRegistryClose(hKey);
+}
+
+static VOID FTSQueryLoadedFirmware(WDFDEVICE Device, FT5X_CONTROLLER_CONTEXT* Controller) {
+	ULONG version;
+	ULONG size;
+	ULONG ecc;
+
+	FTSQueryDeviceValue(Device, L"LoadedFirmwareVersion", &version);
+	FTSQueryDeviceValue(Device, L"LoadedFirmwareImageSize", &size);
+	FTSQueryDeviceValue(Device, L"LoadedFirmwareImageEcc", &ecc);
+
+	if (version > 0xFF || size == 0 || size > BUFFER_SIZE || ecc > 0xFFFF) {
+		return;
+	}
+
+	Controller->LoadedFirmwareVersion = (BYTE)version;
+	Controller->LoadedFirmwareImageSize = size;
+	Controller->LoadedFirmwareImageEcc = (USHORT)ecc;
+}
+
+static VOID FTSSaveLoadedFirmware(WDFDEVICE Device, FT5X_CONTROLLER_CONTEXT* Controller) {
+	FTSSaveDeviceValue(Device, L"LoadedFirmwareVersion", Controller->LoadedFirmwareVersion);
+	FTSSaveDeviceValue(Device, L"LoadedFirmwareImageSize", Controller->LoadedFirmwareImageSize);
+	FTSSaveDeviceValue(Device, L"LoadedFirmwareImageEcc", Controller->LoadedFirmwareImageEcc);
 }
 
 NTSTATUS FTLoadFirmwareFile(WDFDEVICE Device, SPB_CONTEXT* SpbContext) {
@@ -252,13 +399,24 @@ NTSTATUS FTLoadFirmwareFile(WDFDEVICE Device, SPB_CONTEXT* SpbContext) {
 	WDFSTRING FTFWFilePath;
 
 	UINT8 cmd = FTS_ROMBOOT_CMD_START_APP;
-	LARGE_INTEGER Interval;
 
-	UINT8* buffer = (UINT8*)ExAllocatePool2(
+	FT5X_CONTROLLER_CONTEXT* controller = (FT5X_CONTROLLER_CONTEXT*)GetDeviceContext(Device)->TouchContext;
+
+	UINT8* buffer = NULL;
+	ULONG imageSize;
+	UINT16 imageEcc;
+	ULONGLONG start;
+
+	buffer = (UINT8*)ExAllocatePool2(
 		POOL_FLAG_NON_PAGED,
 		BUFFER_SIZE,
 		TOUCH_POOL_TAG
 	);
+	if (buffer == NULL) {
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Failed to allocate firmware buffer %!STATUS!", status);
+		goto exit;
+	}
 
 	WdfStringCreate(NULL, WDF_NO_OBJECT_ATTRIBUTES, &FTFWFilePath);
 
@@ -291,8 +449,10 @@ NTSTATUS FTLoadFirmwareFile(WDFDEVICE Device, SPB_CONTEXT* SpbContext) {
 		OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
 		NULL, NULL);
 
-	if (KeGetCurrentIrql() != PASSIVE_LEVEL)
-		return STATUS_INVALID_DEVICE_STATE;
+	if (KeGetCurrentIrql() != PASSIVE_LEVEL) {
+		status = STATUS_INVALID_DEVICE_STATE;
+		goto exit;
+	}
 
 	status = ZwCreateFile(&handle, GENERIC_READ, &objAttr, &ioStatusBlock, NULL, FILE_ATTRIBUTE_NORMAL, 0, FILE_OPEN, FILE_SYNCHRONOUS_IO_NONALERT, NULL, 0);
 	if (!NT_SUCCESS(status)) {
@@ -303,6 +463,39 @@ NTSTATUS FTLoadFirmwareFile(WDFDEVICE Device, SPB_CONTEXT* SpbContext) {
 	byteOffset.QuadPart = 0;
 	status = ZwReadFile(handle, NULL, NULL, NULL, &ioStatusBlock, buffer, BUFFER_SIZE, &byteOffset, NULL);
 	ZwClose(handle);
+	if (!NT_SUCCESS(status)) {
+		Trace(TRACE_LEVEL_ERROR, TRACE_FTFWUPDATE, "Failed to read file %!STATUS!", status);
+		goto exit;
+	}
+
+	//
+	// Identify the image by its size and host ECC, the ECC works on words
+	//
+	imageSize = (ULONG)ioStatusBlock.Information;
+	FTSEccCalHost(buffer, imageSize & ~1UL, &imageEcc);
+
+	//
+	// If the application we loaded last time from this very image is still
+	// running there is nothing to do
+	//
+	if (!controller->TouchSettings.ForceFlash) {
+		if (controller->LoadedFirmwareVersion == 0) {
+			FTSQueryLoadedFirmware(Device, controller);
+		}
+
+		if (controller->LoadedFirmwareVersion != 0 &&
+			controller->LoadedFirmwareImageSize == imageSize &&
+			controller->LoadedFirmwareImageEcc == imageEcc) {
+			Ft5xGetFirmwareVersion(controller, SpbContext);
+			if (controller->FirmwareVersion == controller->LoadedFirmwareVersion) {
+				Trace(TRACE_LEVEL_INFORMATION, TRACE_FTFWUPDATE, "Firmware 0x%X already running, skipping download", controller->FirmwareVersion);
+				status = STATUS_SUCCESS;
+				goto exit;
+			}
+		}
+	}
+
+	start = KeQueryInterruptTime();
 
 	status = FTSPramWriteEcc(SpbContext, buffer);
 	if (!NT_SUCCESS(status)) {
@@ -322,9 +515,24 @@ NTSTATUS FTLoadFirmwareFile(WDFDEVICE Device, SPB_CONTEXT* SpbContext) {
 		goto exit;
 	}
 
-	Interval.QuadPart = 1500000;
-	KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+	status = FTSWaitAppReady(SpbContext, &controller->FirmwareVersion);
+	if (!NT_SUCCESS(status)) {
+		goto exit;
+	}
+
+	Trace(TRACE_LEVEL_INFORMATION, TRACE_FTFWUPDATE, "Firmware downloaded and running after %llu ms", (KeQueryInterruptTime() - start) / 10000);
+
+	if (controller->LoadedFirmwareVersion != controller->FirmwareVersion ||
+		controller->LoadedFirmwareImageSize != imageSize ||
+		controller->LoadedFirmwareImageEcc != imageEcc) {
+		controller->LoadedFirmwareVersion = controller->FirmwareVersion;
+		controller->LoadedFirmwareImageSize = imageSize;
+		controller->LoadedFirmwareImageEcc = imageEcc;
+		FTSSaveLoadedFirmware(Device, controller);
+	}
 exit:
-	ExFreePoolWithTag(buffer, TOUCH_POOL_TAG);
+	if (buffer != NULL) {
+		ExFreePoolWithTag(buffer, TOUCH_POOL_TAG);
+	}
 	return status;
 }
\ No newline at end of file
@@ -25,6 +25,15 @@
 #include <ftinternal.tmh>
 #include <_spb.h>
 
+#if FT5X_DECODE_SIMD
+#include <arm64_neon.h>
+#endif
+
+//
+// Touch frames are read through the default SPB buffers in one go
+//
+C_ASSERT(FT5X_TOUCH_FRAME_SIZE <= FTS_MAX_TRANSFER_LENGTH);
+
 NTSTATUS
 Ft5xBuildFunctionsTable(
       IN FT5X_CONTROLLER_CONTEXT* ControllerContext,
@@ -91,6 +100,82 @@ exit:
     return STATUS_SUCCESS;
 }
 
+VOID
+Ft5xDecodeTouchFrameScalar(
+      IN const FOCAL_TECH_TOUCH_DATA* Records,
+      IN UINT8 First,
+      IN UINT8 Count,
+      OUT FT5X_TOUCH_FRAME* Frame
+)
+/*++
+
+Routine Description:
+
+      Reference decoder, unpacks Count point records starting at First
+      using the FOCAL_TECH_TOUCH_DATA layout.
+
+--*/
+{
+      for (UINT8 i = First; i < First + Count; i++) {
+            const FOCAL_TECH_TOUCH_DATA* record = &Records[i];
+
+            Frame->X[i] = (UINT16)((record->PositionX_High << 8) | record->PositionX_Low);
+            Frame->Y[i] = (UINT16)((record->PositionY_High << 8) | record->PositionY_Low);
+            Frame->Id[i] = record->TouchId;
+            Frame->Event[i] = record->EventFlag;
+            Frame->Weight[i] = record->TouchWeight;
+            Frame->Area[i] = record->TouchArea;
+      }
+}
+
+#if FT5X_DECODE_SIMD
+//
+// Each record is three little endian words:
+//   w0 = XH | Event << 6 | XL << 8
+//   w1 = YH | Id << 4 | YL << 8
+//   w2 = Weight | Area << 12
+//
+static VOID
+Ft5xDecodeTouchFrame8(
+      IN const UINT8* Records,
+      OUT FT5X_TOUCH_FRAME* Frame
+)
+{
+      uint16x8x3_t w = vld3q_u16((const uint16_t*)Records);
+      uint16x8_t mask0F = vdupq_n_u16(0x000F);
+      uint16x8_t maskFF = vdupq_n_u16(0x00FF);
+
+      vst1q_u16(Frame->X, vorrq_u16(vshlq_n_u16(vandq_u16(w.val[0], mask0F), 8), vshrq_n_u16(w.val[0], 8)));
+      vst1q_u16(Frame->Y, vorrq_u16(vshlq_n_u16(vandq_u16(w.val[1], mask0F), 8), vshrq_n_u16(w.val[1], 8)));
+      vst1_u8(Frame->Event, vmovn_u16(vshrq_n_u16(vandq_u16(w.val[0], maskFF), 6)));
+      vst1_u8(Frame->Id, vmovn_u16(vandq_u16(vshrq_n_u16(w.val[1], 4), mask0F)));
+      vst1_u8(Frame->Weight, vmovn_u16(vandq_u16(w.val[2], maskFF)));
+      vst1_u8(Frame->Area, vmovn_u16(vshrq_n_u16(w.val[2], 12)));
+}
+#endif
+
+VOID
+Ft5xDecodeTouchFrame(
+      IN const FOCAL_TECH_TOUCH_DATA* Records,
+      OUT FT5X_TOUCH_FRAME* Frame
+)
+/*++
+
+Routine Description:
+
+      Unpacks all FT5X_MAX_TOUCH_POINTS point records of a frame in one
+      pass. The result must match Ft5xDecodeTouchFrameScalar bit for bit.
+
+--*/
+{
+#if FT5X_DECODE_SIMD
+      Ft5xDecodeTouchFrame8((const UINT8*)Records, Frame);
+      Ft5xDecodeTouchFrameScalar(Records, 8, FT5X_MAX_TOUCH_POINTS - 8, Frame);
+#else
+      Ft5xDecodeTouchFrameScalar(Records, 0, FT5X_MAX_TOUCH_POINTS, Frame);
+#endif
+}
+
 NTSTATUS
 Ft5xGetObjectStatusFromControllerF12(
       IN VOID* ControllerContext,
@@ -121,31 +206,137 @@ Return Value:
     FT5X_CONTROLLER_CONTEXT* controller;
     controller = (FT5X_CONTROLLER_CONTEXT*)ControllerContext;
 
-    UINT32 base = 0;
+    FT5X_TOUCH_FRAME frame;
 
     UINT8 input_id = 0;
-    UINT8 point[91] = { 0x0 };
-    point[0] = 0x1;
+    UINT8 point[FT5X_TOUCH_FRAME_SIZE + 1] = { 0x0 };
+    UINT8 pointsRead = FT5X_MAX_TOUCH_POINTS;
+    UINT8 pointCount = 0;
+    UINT8 contacts;
+    UINT8 cmd;
+    point[0] = FT5X_TOUCH_DATA_REG;
+
+    if (controller->Config.TouchReadMode != FT5X_TOUCH_READ_ADAPTIVE) {
+        status = FTS_Read(SpbContext, point, point + 1, FT5X_TOUCH_FRAME_SIZE);
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_INTERRUPT, "failed to read finger status data %!STATUS!", status);
+            goto exit;
+        }
+    }
+    else {
+        //
+        // Read the header plus as many point slots as the previous frame
+        // reported, lifted contacts of that frame are still covered
+        //
+        pointsRead = (UINT8)max(controller->PredictedTouchPoints, 1);
+
+        status = FTS_Read(SpbContext, point, point + 1, FT5X_TOUCH_HEADER_SIZE + pointsRead * FT5X_TOUCH_POINT_SIZE);
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_INTERRUPT, "failed to read finger status data %!STATUS!", status);
+            goto exit;
+        }
 
-    status = FTS_Read(SpbContext, point, point + 1, 90);
-    if (!NT_SUCCESS(status)) {
-        Trace(TRACE_LEVEL_ERROR, TRACE_INTERRUPT, "failed to read finger status data %!STATUS!", status);
-        goto exit;
+        controller->TouchFrameReads++;
+
+        pointCount = (UINT8)min(point[2] & 0x0F, FT5X_MAX_TOUCH_POINTS);
+        if (pointCount > pointsRead) {
+            controller->TouchFrameSecondReads++;
+
+            cmd = (UINT8)(FT5X_TOUCH_DATA_REG + FT5X_TOUCH_HEADER_SIZE + pointsRead * FT5X_TOUCH_POINT_SIZE);
+            status = FTS_Read(
+                SpbContext,
+                &cmd,
+                point + 1 + FT5X_TOUCH_HEADER_SIZE + pointsRead * FT5X_TOUCH_POINT_SIZE,
+                (pointCount - pointsRead) * FT5X_TOUCH_POINT_SIZE);
+            if (!NT_SUCCESS(status)) {
+                Trace(TRACE_LEVEL_ERROR, TRACE_INTERRUPT, "failed to read remaining finger status data %!STATUS!", status);
+                goto exit;
+            }
+
+            Trace(
+                TRACE_LEVEL_VERBOSE,
+                TRACE_SAMPLES,
+                "Touch frame needed a second read for %d points, %lu of %lu frames",
+                pointCount,
+                controller->TouchFrameSecondReads,
+                controller->TouchFrameReads);
+
+            pointsRead = pointCount;
+        }
+
+        controller->PredictedTouchPoints = pointCount;
     }
 
-    for (UINT8 i = 0; i < 10; i++) {
-        base = 6 * i;
-        input_id = point[5 + base] >> 4;
-        if (input_id >= 10)
+    Ft5xDecodeTouchFrame((const FOCAL_TECH_TOUCH_DATA*)(point + 1 + FT5X_TOUCH_HEADER_SIZE), &frame);
+
+    //
+    // Records read so far must hold a pressed contact for every touch point
+    // in the header, otherwise they are not packed at the front of the frame
+    // and the remaining slots have to be read as well
+    //
+    if (pointsRead < FT5X_MAX_TOUCH_POINTS) {
+        contacts = 0;
+        for (UINT8 i = 0; i < pointsRead; i++) {
+            if (frame.Id[i] < FT5X_MAX_TOUCH_POINTS &&
+                (frame.Event[i] == FOCAL_TECH_EVENT_PRESS_DOWN || frame.Event[i] == FOCAL_TECH_EVENT_CONTACT))
+                contacts++;
+        }
+
+        if (contacts != pointCount) {
+            controller->TouchFrameFullReads++;
+
+            cmd = (UINT8)(FT5X_TOUCH_DATA_REG + FT5X_TOUCH_HEADER_SIZE + pointsRead * FT5X_TOUCH_POINT_SIZE);
+            status = FTS_Read(
+                SpbContext,
+                &cmd,
+                point + 1 + FT5X_TOUCH_HEADER_SIZE + pointsRead * FT5X_TOUCH_POINT_SIZE,
+                (FT5X_MAX_TOUCH_POINTS - pointsRead) * FT5X_TOUCH_POINT_SIZE);
+            if (!NT_SUCCESS(status)) {
+                Trace(TRACE_LEVEL_ERROR, TRACE_INTERRUPT, "failed to read remaining finger status data %!STATUS!", status);
+                goto exit;
+            }
+
+            Trace(
+                TRACE_LEVEL_VERBOSE,
+                TRACE_SAMPLES,
+                "Touch frame records for %d points were not packed, %lu of %lu frames read in full",
+                pointCount,
+                controller->TouchFrameFullReads,
+                controller->TouchFrameReads);
+
+            pointsRead = FT5X_MAX_TOUCH_POINTS;
+
+            Ft5xDecodeTouchFrame((const FOCAL_TECH_TOUCH_DATA*)(point + 1 + FT5X_TOUCH_HEADER_SIZE), &frame);
+        }
+    }
+
+    Data->ReadTime = KeQueryPerformanceCounter(NULL).QuadPart;
+
+    for (UINT8 i = 0; i < pointsRead; i++) {
+        input_id = frame.Id[i];
+
+        //
+        // Press down and contact events carry a valid position, lift up
+        // carries the position the finger left the screen at
+        //
+        if (input_id >= FT5X_MAX_TOUCH_POINTS || frame.Event[i] == FOCAL_TECH_EVENT_NONE)
             continue;
 
-        if ((point[3 + base] >> 6) == 0x0 || (point[3 + base] >> 6) == 0x2) {
+        if (frame.Event[i] == FOCAL_TECH_EVENT_LIFT_UP) {
+            Data->Lifted |= (1 << input_id);
+        }
+        else {
             Data->States[input_id] = OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS;
-            Data->Positions[input_id].X = ((point[3 + base] & 0x0F) << 8) + (point[4 + base] & 0xFF);
-            Data->Positions[input_id].Y = ((point[5 + base] & 0x0F) << 8) + (point[6 + base] & 0xFF);
-       }
+        }
+
+        Data->Positions[input_id].X = frame.X[i];
+        Data->Positions[input_id].Y = frame.Y[i];
+        Data->Weights[input_id] = frame.Weight[i];
+        Data->Areas[input_id] = frame.Area[i];
     }
 
+    Data->DecodeTime = KeQueryPerformanceCounter(NULL).QuadPart;
+
 exit:
     return status;
 }
@@ -159,9 +350,21 @@ TchServiceObjectInterrupts(
 {
       NTSTATUS status = STATUS_SUCCESS;
       DETECTED_OBJECTS data;
+      LONGLONG interruptTime;
 
       RtlZeroMemory(&data, sizeof(data));
 
+      //
+      // Frames serviced outside of the ISR have no interrupt timestamp
+      //
+      interruptTime = ReportContext->InterruptTimestamp.QuadPart;
+      data.Timestamp = ReportContext->InterruptTimestamp;
+      if (data.Timestamp.QuadPart == 0)
+      {
+            data.Timestamp = KeQueryPerformanceCounter(NULL);
+      }
+      ReportContext->InterruptTimestamp.QuadPart = 0;
+
       //
       // See if new touch data is available
       //
@@ -171,6 +374,13 @@ TchServiceObjectInterrupts(
             &data
       );
 
+      ReportTraceInformation(
+            ReportContext,
+            REPORT_TRACE_EVENT_FRAME,
+            (USHORT)data.Lifted,
+            (ULONG)(KeQueryPerformanceCounter(NULL).QuadPart - data.Timestamp.QuadPart),
+            (ULONG)status);
+
       if (!NT_SUCCESS(status))
       {
             Trace(
@@ -182,10 +392,31 @@ TchServiceObjectInterrupts(
             goto exit;
       }
 
+      //
+      // Only frames read in response to an interrupt count towards latency
+      //
+      if (interruptTime != 0)
+      {
+            ReportLatencyRecord(
+                  ReportContext,
+                  REPORT_LATENCY_STAGE_READ,
+                  data.ReadTime - interruptTime);
+            ReportLatencyRecord(
+                  ReportContext,
+                  REPORT_LATENCY_STAGE_DECODE,
+                  data.DecodeTime - data.ReadTime);
+
+            ReportContext->Latency.FrameInterruptTime = interruptTime;
+            ReportContext->Latency.FrameDecodeTime = data.DecodeTime;
+      }
+
       status = ReportObjects(
             ReportContext,
             data);
 
+      ReportContext->Latency.FrameInterruptTime = 0;
+      ReportContext->Latency.FrameDecodeTime = 0;
+
       if (!NT_SUCCESS(status))
       {
             Trace(
@@ -265,11 +496,49 @@ Ft5xGetFirmwareVersion(
     IN FT5X_CONTROLLER_CONTEXT* ControllerContext,
     IN SPB_CONTEXT* SpbContext
 )
+/*++
+
+Routine Description:
+
+      Reads the version of the firmware application currently running on
+      the controller. While the controller sits in the ROM boot loader there
+      is no application to answer, so the version is recorded as unknown (0)
+      rather than failing device start.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current SPB context
+
+Return Value:
+
+      NTSTATUS indicating success or failure
+
+--*/
 {
-      UNREFERENCED_PARAMETER(SpbContext);
-      UNREFERENCED_PARAMETER(ControllerContext);
+    NTSTATUS status;
+    UINT8 cmd[1] = { FTS_REG_FW_VER };
+    UINT8 version[1] = { 0 };
 
-      return STATUS_SUCCESS;
+    ControllerContext->FirmwareVersion = 0;
+
+    status = FTS_Read(SpbContext, cmd, version, 1);
+    if (!NT_SUCCESS(status)) {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_INIT,
+            "Failed to read firmware version - 0x%08lX",
+            status);
+        goto exit;
+    }
+
+    if (version[0] != 0xFF) {
+        ControllerContext->FirmwareVersion = version[0];
+    }
+
+    Trace(TRACE_LEVEL_INFORMATION, TRACE_INIT, "Firmware version: 0x%02x", ControllerContext->FirmwareVersion);
+exit:
+    return STATUS_SUCCESS;
 }
 
 NTSTATUS
@@ -36,20 +36,62 @@ const PWSTR gpwstrProductID = L"5x06";
 const PWSTR gpwstrSerialNumber = L"5x06";
 
 //
-// HID Report Descriptor for a touch device
+// Collections following the generated finger collection in the HID Report
+// Descriptor for a touch device
 //
 
-const UCHAR gReportDescriptor[] = {
+const UCHAR gReportDescriptorTail[] = {
 	/*FOCALTECH_FT5X_DIGITIZER_DIAGNOSTIC1,
 	FOCALTECH_FT5X_DIGITIZER_DIAGNOSTIC2,
 	FOCALTECH_FT5X_DIGITIZER_DIAGNOSTIC3,
 	FOCALTECH_FT5X_DIGITIZER_DIAGNOSTIC4,*/
-	FOCALTECH_FT5X_DIGITIZER_FINGER,
 	FOCALTECH_FT5X_DIGITIZER_REPORTMODE,
 	//FOCALTECH_FT5X_DIGITIZER_KEYPAD,
 	//FOCALTECH_FT5X_DIGITIZER_STYLUS
 };
-const ULONG gdwcbReportDescriptor = sizeof(gReportDescriptor);
+
+//
+// Finger collection fields, see HID_FINGER_CONTACT_FIELDS
+//
+typedef struct _HID_DESCRIPTOR_FIELD
+{
+	ULONG UsagePage;
+	ULONG Usage;
+	ULONG ReportSize;
+	ULONG ReportCount;
+	LONG LogicalMaximum;
+	ULONG Unit;
+	ULONG Flags;
+} HID_DESCRIPTOR_FIELD;
+
+#define HID_FIELD_ENTRY(UsagePage, Usage, ReportSize, ReportCount, LogicalMaximum, Unit, Flags) \
+	{ UsagePage, Usage, ReportSize, ReportCount, LogicalMaximum, Unit, Flags },
+
+static const HID_DESCRIPTOR_FIELD gFingerContactFields[] = {
+	HID_FINGER_CONTACT_FIELDS(HID_FIELD_ENTRY)
+};
+
+static const HID_DESCRIPTOR_FIELD gFingerSizeFields[] = {
+	HID_FINGER_SIZE_FIELDS(HID_FIELD_ENTRY)
+};
+
+static const HID_DESCRIPTOR_FIELD gFingerReportFields[] = {
+	HID_FINGER_REPORT_FIELDS(HID_FIELD_ENTRY)
+};
+
+//
+// The report structures must have exactly the layout the descriptor
+// declares for them
+//
+C_ASSERT(HID_FINGER_CONTACT_BITS == 8 * sizeof(HID_TOUCH_FINGER));
+C_ASSERT(HID_FINGER_CONTACT_BITS + HID_FINGER_SIZE_BITS == 8 * sizeof(HID_TOUCH_FINGER_EX));
+C_ASSERT(RTL_NUMBER_OF_FIELD(HID_TOUCH_REPORT, Contacts) == PTP_MAX_CONTACT_POINTS);
+C_ASSERT(RTL_NUMBER_OF_FIELD(HID_TOUCH_REPORT_EX, Contacts) == PTP_MAX_CONTACT_POINTS);
+C_ASSERT(HID_FINGER_REPORT_BITS ==
+	8 * (sizeof(HID_TOUCH_REPORT) - RTL_FIELD_SIZE(HID_TOUCH_REPORT, Contacts)));
+C_ASSERT(HID_FINGER_REPORT_BITS ==
+	8 * (sizeof(HID_TOUCH_REPORT_EX) - RTL_FIELD_SIZE(HID_TOUCH_REPORT_EX, Contacts)));
+C_ASSERT(sizeof(gReportDescriptorTail) < HID_REPORT_DESCRIPTOR_MAX_LENGTH);
 
 //
 // HID Descriptor for a touch device
@@ -63,14 +105,41 @@ const HID_DESCRIPTOR gHidDescriptor =
 	1,                                  //bNumDescriptors
 	{                                   //DescriptorList[0]
 		HID_REPORT_DESCRIPTOR_TYPE,     //bReportType
-		sizeof(gReportDescriptor)       //wReportLength
+		0                               //wReportLength - set from the generated descriptor
 	}
 };
 
+//
+// Report descriptor being generated. Global items are only emitted when
+// their value changes
+//
+typedef struct _HID_DESCRIPTOR_BUILDER
+{
+	PUCHAR Buffer;
+	ULONG Capacity;
+	ULONG Length;
+
+	ULONG UsagePage;
+	BOOLEAN LogicalMinimumSet;
+	LONG LogicalMaximum;
+	ULONG ReportSize;
+	ULONG ReportCount;
+	ULONG Unit;
+
+	//
+	// Input bits declared since the last report ID
+	//
+	ULONG InputBits;
+
+	UINT32 DisplayWidth;
+	UINT32 DisplayHeight;
+} HID_DESCRIPTOR_BUILDER;
+
 NTSTATUS
 TchSendReport(
 	IN WDFQUEUE PingPongQueue,
-	IN PHID_INPUT_REPORT hidReportFromDriver
+	IN PHID_INPUT_REPORT hidReportFromDriver,
+	IN ULONG hidReportLength
 )
 {
 	NTSTATUS status;
@@ -81,87 +150,6 @@ TchSendReport(
 	status = STATUS_SUCCESS;
 	request = NULL;
 
-	switch (hidReportFromDriver->ReportID)
-	{
-	case REPORTID_STYLUS:
-	{
-	Trace(
-		TRACE_LEVEL_INFORMATION,
-		TRACE_HID,
-		"HID pen: "
-		"Tip Switch = %d, "
-		"Barrel Switch = %d, "
-		"Invert = %d, "
-		"Eraser = %d, "
-		"In Range = %d, "
-		"X = %d, "
-		"Y = %d, "
-		"Tip Pressure = %d, "
-		"X Tilt = %d, "
-		"Y Tilt = %d",
-		hidReportFromDriver->PenReport.TipSwitch,
-		hidReportFromDriver->PenReport.BarrelSwitch,
-		hidReportFromDriver->PenReport.Invert,
-		hidReportFromDriver->PenReport.Eraser,
-		hidReportFromDriver->PenReport.InRange,
-		hidReportFromDriver->PenReport.X,
-		hidReportFromDriver->PenReport.Y,
-		hidReportFromDriver->PenReport.TipPressure,
-		hidReportFromDriver->PenReport.XTilt,
-		hidReportFromDriver->PenReport.YTilt);
-	break;
-	}
-	case REPORTID_FINGER:
-	{
-		Trace(
-			TRACE_LEVEL_INFORMATION,
-			TRACE_HID,
-			"HID Finger: "
-			"Contact Count = %d\n"
-			"Tip Switch = %d, "
-			"In Range = %d, "
-			"Confidence = %d, "
-			"Contact ID = %d, "
-			"X = %d, "
-			"Y = %d\n"
-			"Tip Switch = %d, "
-			"In Range = %d, "
-			"Confidence = %d, "
-			"Contact ID = %d, "
-			"X = %d, "
-			"Y = %d",
-			hidReportFromDriver->TouchReport.ContactCount,
-			hidReportFromDriver->TouchReport.Contacts[0].TipSwitch,
-			hidReportFromDriver->TouchReport.Contacts[0].InRange,
-			hidReportFromDriver->TouchReport.Contacts[0].Confidence,
-			hidReportFromDriver->TouchReport.Contacts[0].ContactID,
-			hidReportFromDriver->TouchReport.Contacts[0].X,
-			hidReportFromDriver->TouchReport.Contacts[0].Y,
-			hidReportFromDriver->TouchReport.Contacts[1].TipSwitch,
-			hidReportFromDriver->TouchReport.Contacts[1].InRange,
-			hidReportFromDriver->TouchReport.Contacts[1].Confidence,
-			hidReportFromDriver->TouchReport.Contacts[1].ContactID,
-			hidReportFromDriver->TouchReport.Contacts[1].X,
-			hidReportFromDriver->TouchReport.Contacts[1].Y);
-		break;
-	}
-	case REPORTID_KEYPAD:
-	{
-		Trace(
-			TRACE_LEVEL_INFORMATION,
-			TRACE_HID,
-			"HID key: "
-			"System Power Down = %d, "
-			"Start = %d, "
-			"AC Search = %d, "
-			"AC Back = %d",
-			hidReportFromDriver->KeyReport.SystemPowerDown,
-			hidReportFromDriver->KeyReport.Start,
-			hidReportFromDriver->KeyReport.ACSearch,
-			hidReportFromDriver->KeyReport.ACBack);
-	}
-	}
-
 	//
 	// Complete a HIDClass request if one is available
 	//
@@ -172,9 +160,9 @@ TchSendReport(
 	if (!NT_SUCCESS(status))
 	{
 		Trace(
-			TRACE_LEVEL_ERROR,
+			TRACE_LEVEL_VERBOSE,
 			TRACE_REPORTING,
-			"No request pending from HIDClass, ignoring report - 0x%08lX",
+			"No request pending from HIDClass - 0x%08lX",
 			status);
 
 		goto exit;
@@ -185,7 +173,7 @@ TchSendReport(
 	//
 	status = WdfRequestRetrieveOutputBuffer(
 		request,
-		sizeof(HID_INPUT_REPORT),
+		hidReportLength,
 		&hidReportRequestBuffer,
 		&hidReportRequestBufferLength);
 
@@ -202,7 +190,7 @@ TchSendReport(
 		//
 		// Validate the size of the output buffer
 		//
-		if (hidReportRequestBufferLength < sizeof(HID_INPUT_REPORT))
+		if (hidReportRequestBufferLength < hidReportLength)
 		{
 			status = STATUS_BUFFER_TOO_SMALL;
 
@@ -218,9 +206,9 @@ TchSendReport(
 			RtlCopyMemory(
 				hidReportRequestBuffer,
 				hidReportFromDriver,
-				sizeof(HID_INPUT_REPORT));
+				hidReportLength);
 
-			WdfRequestSetInformation(request, sizeof(HID_INPUT_REPORT));
+			WdfRequestSetInformation(request, hidReportLength);
 		}
 	}
 
@@ -282,6 +270,11 @@ Return Value:
 		*Pending = TRUE;
 	}
 
+	//
+	// Hand out reports that were generated while no request was posted
+	//
+	ReportDrainPendingReports(&devContext->ReportContext);
+
 	//
 	// Service any interrupt that may have asserted while the framework had
 	// interrupts disabled, or occurred before a read request was queued.
@@ -383,85 +376,437 @@ Return Value:
 	return status;
 }
 
-NTSTATUS
-TchGenerateHidReportDescriptor(
-	IN WDFDEVICE Device,
-	IN WDFMEMORY Memory
+static VOID
+TchDescriptorItem(
+	IN HID_DESCRIPTOR_BUILDER* Builder,
+	IN UCHAR Prefix,
+	IN ULONG Data,
+	IN ULONG Size
 )
+/*++
+
+Routine Description:
+
+	Appends a short item with 0, 1, 2 or 4 bytes of data. Items that do not
+	fit are only counted, the caller checks the length once at the end.
+
+--*/
 {
-	PDEVICE_EXTENSION devContext;
-	FT5X_CONTROLLER_CONTEXT* touchContext;
-	NTSTATUS status;
+	ULONG i;
 
-	devContext = GetDeviceContext(Device);
+	if (Builder->Length + 1 + Size <= Builder->Capacity)
+	{
+		Builder->Buffer[Builder->Length] = (UCHAR)((Prefix & 0xFC) | (Size == 4 ? 3 : Size));
 
-	touchContext = (FT5X_CONTROLLER_CONTEXT*)devContext->TouchContext;
+		for (i = 0; i < Size; i++)
+		{
+			Builder->Buffer[Builder->Length + 1 + i] = (UCHAR)(Data >> (8 * i));
+		}
+	}
 
-	PUCHAR hidReportDescBuffer = (PUCHAR)ExAllocatePoolWithTag(
-		NonPagedPool,
-		gdwcbReportDescriptor,
-		TOUCH_POOL_TAG
-	);
+	Builder->Length += 1 + Size;
+}
+
+static VOID
+TchDescriptorUnsigned(
+	IN HID_DESCRIPTOR_BUILDER* Builder,
+	IN UCHAR Prefix,
+	IN ULONG Value
+)
+{
+	TchDescriptorItem(Builder, Prefix, Value, Value <= 0xFF ? 1 : (Value <= 0xFFFF ? 2 : 4));
+}
+
+static VOID
+TchDescriptorSigned(
+	IN HID_DESCRIPTOR_BUILDER* Builder,
+	IN UCHAR Prefix,
+	IN LONG Value
+)
+{
+	TchDescriptorItem(
+		Builder,
+		Prefix,
+		(ULONG)Value,
+		(Value >= -128 && Value <= 127) ? 1 : ((Value >= -32768 && Value <= 32767) ? 2 : 4));
+}
+
+static VOID
+TchDescriptorUsage(
+	IN HID_DESCRIPTOR_BUILDER* Builder,
+	IN ULONG UsagePage,
+	IN ULONG Usage
+)
+{
+	if (UsagePage != Builder->UsagePage)
+	{
+		TchDescriptorUnsigned(Builder, UsagePage <= 0xFF ? USAGE_PAGE : USAGE_PAGE_1, UsagePage);
+		Builder->UsagePage = UsagePage;
+	}
 
-	if (hidReportDescBuffer == NULL)
+	TchDescriptorUnsigned(Builder, USAGE, Usage);
+}
+
+static VOID
+TchDescriptorGlobals(
+	IN HID_DESCRIPTOR_BUILDER* Builder,
+	IN LONG LogicalMaximum,
+	IN ULONG Unit,
+	IN ULONG ReportSize,
+	IN ULONG ReportCount
+)
+{
+	if (Unit != Builder->Unit)
 	{
-		Trace(
-			TRACE_LEVEL_INFORMATION,
-			TRACE_HID,
-			"Failed to create hidReportDescBuffer on %p",
-			hidReportDescBuffer);
+		TchDescriptorUnsigned(Builder, UNIT_EXPONENT, (Unit >> 16) & 0xF);
+		TchDescriptorUnsigned(Builder, UNIT, Unit & 0xFFFF);
+		Builder->Unit = Unit;
+	}
 
-		return STATUS_FATAL_MEMORY_EXHAUSTION;
+	if (!Builder->LogicalMinimumSet)
+	{
+		TchDescriptorSigned(Builder, LOGICAL_MINIMUM, 0);
+		Builder->LogicalMinimumSet = TRUE;
 	}
 
-	RtlCopyBytes(
-		hidReportDescBuffer,
-		gReportDescriptor,
-		gdwcbReportDescriptor
-	);
+	if (LogicalMaximum != Builder->LogicalMaximum)
+	{
+		TchDescriptorSigned(Builder, LOGICAL_MAXIMUM, LogicalMaximum);
+		Builder->LogicalMaximum = LogicalMaximum;
+	}
+
+	if (ReportSize != Builder->ReportSize)
+	{
+		TchDescriptorUnsigned(Builder, REPORT_SIZE, ReportSize);
+		Builder->ReportSize = ReportSize;
+	}
+
+	if (ReportCount != Builder->ReportCount)
+	{
+		TchDescriptorUnsigned(Builder, REPORT_COUNT, ReportCount);
+		Builder->ReportCount = ReportCount;
+	}
+}
+
+static VOID
+TchDescriptorReportId(
+	IN HID_DESCRIPTOR_BUILDER* Builder,
+	IN UCHAR ReportId
+)
+{
+	TchDescriptorUnsigned(Builder, REPORT_ID, ReportId);
+	Builder->InputBits = 0;
+}
+
+static VOID
+TchDescriptorFields(
+	IN HID_DESCRIPTOR_BUILDER* Builder,
+	IN const HID_DESCRIPTOR_FIELD* Fields,
+	IN ULONG Count
+)
+/*++
+
+Routine Description:
+
+	Declares a run of input fields from one of the field tables.
+
+--*/
+{
+	const HID_DESCRIPTOR_FIELD* field;
+	LONG logicalMaximum;
+	ULONG i;
 
-	for (unsigned int i = 0; i < gdwcbReportDescriptor - 2; i++)
+	for (i = 0; i < Count; i++)
 	{
-		if (*(hidReportDescBuffer + i) == LOGICAL_MAXIMUM_2)
+		field = &Fields[i];
+
+		switch (field->LogicalMaximum)
 		{
-			if (*(hidReportDescBuffer + i + 1) == 0xFE &&
-				*(hidReportDescBuffer + i + 2) == 0xFE)
-			{
-				*(hidReportDescBuffer + i + 1) = devContext->ReportContext.Props.DisplayPhysicalWidth & 0xFF;
-				*(hidReportDescBuffer + i + 2) = (devContext->ReportContext.Props.DisplayPhysicalWidth >> 8) & 0xFF;
-			}
-			if (*(hidReportDescBuffer + i + 1) == 0xFD &&
-				*(hidReportDescBuffer + i + 2) == 0xFD)
-			{
-				*(hidReportDescBuffer + i + 1) = devContext->ReportContext.Props.DisplayPhysicalHeight & 0xFF;
-				*(hidReportDescBuffer + i + 2) = (devContext->ReportContext.Props.DisplayPhysicalHeight >> 8) & 0xFF;
-			}
+		case HID_LOGICAL_MAX_DISPLAY_WIDTH:
+			logicalMaximum = (LONG)Builder->DisplayWidth;
+			break;
+		case HID_LOGICAL_MAX_DISPLAY_HEIGHT:
+			logicalMaximum = (LONG)Builder->DisplayHeight;
+			break;
+		default:
+			logicalMaximum = field->LogicalMaximum;
+			break;
 		}
-		else if (*(hidReportDescBuffer + i) == PHYSICAL_MAXIMUM_2)
+
+		TchDescriptorGlobals(
+			Builder,
+			logicalMaximum,
+			field->Unit,
+			field->ReportSize,
+			field->ReportCount);
+
+		if (field->Usage != 0)
+		{
+			TchDescriptorUsage(Builder, field->UsagePage, field->Usage);
+		}
+
+		TchDescriptorUnsigned(Builder, INPUT, field->Flags);
+		Builder->InputBits += field->ReportSize * field->ReportCount;
+	}
+}
+
+static VOID
+TchDescriptorFingerCollection(
+	IN HID_DESCRIPTOR_BUILDER* Builder,
+	IN BOOLEAN ContactSize,
+	IN ULONG ContactsPerReport,
+	OUT ULONG* FingerReportLength
+)
+/*++
+
+Routine Description:
+
+	Declares the touch screen application collection: the finger input
+	report, and the maximum contact count and certification feature
+	reports.
+
+Arguments:
+
+	Builder - Descriptor being generated
+	ContactSize - TRUE to declare contact size and pressure per contact
+	ContactsPerReport - Contacts declared in the finger input report
+	FingerReportLength - Receives the finger input report length in bytes,
+		report ID included
+
+Return Value:
+
+	None.
+
+--*/
+{
+	ULONG contact;
+
+	TchDescriptorUsage(Builder, HID_USAGE_PAGE_DIGITIZER, 0x04); /* Touch Screen */
+	TchDescriptorUnsigned(Builder, BEGIN_COLLECTION, 0x01); /* Application */
+
+	TchDescriptorReportId(Builder, REPORTID_FINGER);
+
+	for (contact = 0; contact < ContactsPerReport; contact++)
+	{
+		TchDescriptorUsage(Builder, HID_USAGE_PAGE_DIGITIZER, 0x22); /* Finger */
+		TchDescriptorUnsigned(Builder, BEGIN_COLLECTION, 0x02); /* Logical */
+
+		TchDescriptorFields(Builder, gFingerContactFields, RTL_NUMBER_OF(gFingerContactFields));
+
+		if (ContactSize)
 		{
-			if (*(hidReportDescBuffer + i + 1) == 0xFE &&
-				*(hidReportDescBuffer + i + 2) == 0xFE)
-			{
-				*(hidReportDescBuffer + i + 1) = devContext->ReportContext.Props.DisplayWidth10um & 0xFF;
-				*(hidReportDescBuffer + i + 2) = (devContext->ReportContext.Props.DisplayWidth10um >> 8) & 0xFF;
-			}
-			if (*(hidReportDescBuffer + i + 1) == 0xFD &&
-				*(hidReportDescBuffer + i + 2) == 0xFD)
-			{
-				*(hidReportDescBuffer + i + 1) = devContext->ReportContext.Props.DisplayHeight10um & 0xFF;
-				*(hidReportDescBuffer + i + 2) = (devContext->ReportContext.Props.DisplayHeight10um >> 8) & 0xFF;
-			}
+			TchDescriptorFields(Builder, gFingerSizeFields, RTL_NUMBER_OF(gFingerSizeFields));
 		}
+
+		TchDescriptorItem(Builder, END_COLLECTION, 0, 0);
 	}
 
+	TchDescriptorFields(Builder, gFingerReportFields, RTL_NUMBER_OF(gFingerReportFields));
+
+	*FingerReportLength = 1 + Builder->InputBits / 8;
+
+	TchDescriptorReportId(Builder, REPORTID_DEVICE_CAPS);
+	TchDescriptorGlobals(Builder, PTP_MAX_CONTACT_POINTS, HID_UNIT_NONE, 8, 1);
+	TchDescriptorUsage(Builder, HID_USAGE_PAGE_DIGITIZER, 0x55); /* Maximum Contacts */
+	TchDescriptorUnsigned(Builder, FEATURE, 0x02);
+
+	TchDescriptorUsage(Builder, 0xFF00, 0xC5); /* Certification blob */
+	TchDescriptorReportId(Builder, REPORTID_PTPHQA);
+	TchDescriptorGlobals(Builder, 0xFF, HID_UNIT_NONE, 8, 256);
+	TchDescriptorUnsigned(Builder, FEATURE, 0x02);
+
+	TchDescriptorItem(Builder, END_COLLECTION, 0, 0);
+}
+
+static VOID
+TchDescriptorDiagnosticCollection(
+	IN HID_DESCRIPTOR_BUILDER* Builder
+)
+/*++
+
+Routine Description:
+
+	Declares the vendor collection diagnostics are read back through: the
+	interrupt service path latency histograms, see ReportLatencyRead, the
+	driver counters, see TchGetFeatureReport, and the hot path trace, see
+	ReportTraceRead.
+
+--*/
+{
+	TchDescriptorUsage(Builder, 0xFF05, 0x07); /* Vendor Defined */
+	TchDescriptorUnsigned(Builder, BEGIN_COLLECTION, 0x01); /* Application */
+
+	TchDescriptorReportId(Builder, REPORTID_LATENCY);
+	TchDescriptorGlobals(
+		Builder,
+		0xFF,
+		HID_UNIT_NONE,
+		8,
+		sizeof(REPORT_LATENCY_FEATURE_REPORT) - 1);
+	TchDescriptorUsage(Builder, 0xFF05, 0x41); /* Latency histograms */
+	TchDescriptorUnsigned(Builder, FEATURE, 0x02);
+
+	TchDescriptorReportId(Builder, REPORTID_COUNTERS);
+	TchDescriptorGlobals(
+		Builder,
+		0xFF,
+		HID_UNIT_NONE,
+		8,
+		sizeof(HID_COUNTERS_FEATURE_REPORT) - 1);
+	TchDescriptorUsage(Builder, 0xFF05, 0x42); /* Driver counters */
+	TchDescriptorUnsigned(Builder, FEATURE, 0x02);
+
+#if REPORT_TRACE_LEVEL > 0
+	TchDescriptorReportId(Builder, REPORTID_TRACE);
+	TchDescriptorGlobals(
+		Builder,
+		0xFF,
+		HID_UNIT_NONE,
+		8,
+		sizeof(REPORT_TRACE_FEATURE_REPORT) - 1);
+	TchDescriptorUsage(Builder, 0xFF05, 0x40); /* Trace records */
+	TchDescriptorUnsigned(Builder, FEATURE, 0x02);
+#endif
+
+	TchDescriptorItem(Builder, END_COLLECTION, 0, 0);
+}
+
+NTSTATUS
+TchBuildReportDescriptor(
+	IN WDFDEVICE Device
+)
+/*++
+
+Routine Description:
+
+	Brings the cached report descriptor up to date with the report layout
+	in use and the current screen properties. The descriptor is only
+	generated again when one of them changed.
+
+Arguments:
+
+	Device - Handle to WDF Device Object
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	PDEVICE_EXTENSION devContext;
+	HID_REPORT_DESCRIPTOR_CACHE* cache;
+	PTOUCH_SCREEN_PROPERTIES props;
+	HID_DESCRIPTOR_BUILDER builder;
+	BOOLEAN contactSize;
+	ULONG contactsPerReport;
+	ULONG fingerReportLength;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	devContext = GetDeviceContext(Device);
+	cache = &devContext->ReportDescriptor;
+	props = &devContext->ReportContext.Props;
+	contactSize = devContext->ReportContext.ContactSize;
+	contactsPerReport = devContext->ReportContext.ContactsPerReport;
+
+	if (cache->Built &&
+		cache->ContactSize == contactSize &&
+		cache->ContactsPerReport == contactsPerReport &&
+		cache->DisplayWidth == props->DisplayPhysicalWidth &&
+		cache->DisplayHeight == props->DisplayPhysicalHeight)
+	{
+		goto exit;
+	}
+
+	RtlZeroMemory(&builder, sizeof(builder));
+	builder.Buffer = cache->Descriptor;
+	builder.Capacity = sizeof(cache->Descriptor);
+	builder.UsagePage = MAXULONG;
+	builder.LogicalMaximum = MAXLONG;
+	builder.ReportSize = MAXULONG;
+	builder.ReportCount = MAXULONG;
+	builder.Unit = HID_UNIT_NONE;
+	builder.DisplayWidth = props->DisplayPhysicalWidth;
+	builder.DisplayHeight = props->DisplayPhysicalHeight;
+
+	cache->Built = FALSE;
+
+	TchDescriptorFingerCollection(&builder, contactSize, contactsPerReport, &fingerReportLength);
+	TchDescriptorDiagnosticCollection(&builder);
+
+	if (builder.Length + sizeof(gReportDescriptorTail) > builder.Capacity)
+	{
+		status = STATUS_BUFFER_OVERFLOW;
+
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_HID,
+			"Report descriptor needs %d bytes, only %d available - 0x%08lX",
+			(ULONG)(builder.Length + sizeof(gReportDescriptorTail)),
+			builder.Capacity,
+			status);
+
+		goto exit;
+	}
+
+	RtlCopyMemory(
+		builder.Buffer + builder.Length,
+		gReportDescriptorTail,
+		sizeof(gReportDescriptorTail));
+	builder.Length += sizeof(gReportDescriptorTail);
+
 	//
-	// Use hardcoded Report descriptor
+	// Reports are packed by the report code, it must agree with what was
+	// declared here
 	//
+	NT_ASSERT(fingerReportLength == HID_FINGER_REPORT_LENGTH(contactsPerReport, contactSize));
+	NT_ASSERT(fingerReportLength == devContext->ReportContext.FingerReportLength);
+
+	cache->Length = builder.Length;
+	cache->FingerReportLength = fingerReportLength;
+	cache->ContactSize = contactSize;
+	cache->ContactsPerReport = contactsPerReport;
+	cache->DisplayWidth = props->DisplayPhysicalWidth;
+	cache->DisplayHeight = props->DisplayPhysicalHeight;
+	cache->Built = TRUE;
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_HID,
+		"Report descriptor built, %d bytes, finger report %d bytes",
+		cache->Length,
+		cache->FingerReportLength);
+
+exit:
+	return status;
+}
+
+NTSTATUS
+TchGenerateHidReportDescriptor(
+	IN WDFDEVICE Device,
+	IN WDFMEMORY Memory
+)
+{
+	PDEVICE_EXTENSION devContext;
+	NTSTATUS status;
+
+	devContext = GetDeviceContext(Device);
+
+	//
+	// Normally a no-op, picks up screen properties or a report layout that
+	// changed since the device started
+	//
+	status = TchBuildReportDescriptor(Device);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
 	status = WdfMemoryCopyFromBuffer(
 		Memory,
 		0,
-		(PVOID)hidReportDescBuffer,
-		gdwcbReportDescriptor);
+		(PVOID)devContext->ReportDescriptor.Descriptor,
+		devContext->ReportDescriptor.Length);
 
 	if (!NT_SUCCESS(status))
 	{
@@ -474,7 +819,6 @@ TchGenerateHidReportDescriptor(
 	}
 
 exit:
-	ExFreePoolWithTag((PVOID)hidReportDescBuffer, TOUCH_POOL_TAG);
 	return status;
 }
 
@@ -504,8 +848,7 @@ Return Value:
 {
 	WDFMEMORY memory;
 	NTSTATUS status;
-
-	UNREFERENCED_PARAMETER(Device);
+	HID_DESCRIPTOR hidDescriptor;
 
 	//
 	// This IOCTL is METHOD_NEITHER so WdfRequestRetrieveOutputMemory
@@ -529,13 +872,25 @@ Return Value:
 	}
 
 	//
-	// Use hardcoded global HID Descriptor
+	// Use hardcoded global HID Descriptor, sized for the report descriptor
+	// in use
 	//
+	status = TchBuildReportDescriptor(Device);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	RtlCopyMemory(&hidDescriptor, &gHidDescriptor, sizeof(hidDescriptor));
+	hidDescriptor.DescriptorList[0].wReportLength =
+		(USHORT)GetDeviceContext(Device)->ReportDescriptor.Length;
+
 	status = WdfMemoryCopyFromBuffer(
 		memory,
 		0,
-		(PUCHAR) &gHidDescriptor,
-		sizeof(gHidDescriptor));
+		(PUCHAR) &hidDescriptor,
+		sizeof(hidDescriptor));
 
 	if (!NT_SUCCESS(status))
 	{
@@ -629,7 +984,7 @@ Return Value:
 	//
 	// Report how many bytes were copied
 	//
-	WdfRequestSetInformation(Request, gdwcbReportDescriptor);
+	WdfRequestSetInformation(Request, GetDeviceContext(Device)->ReportDescriptor.Length);
 
 exit:
 
@@ -992,6 +1347,83 @@ Return Value:
 
 		break;
 	}
+	case REPORTID_LATENCY:
+	{
+		// Size sanity check
+		ReportSize = sizeof(REPORT_LATENCY_FEATURE_REPORT);
+		if (featurePacket->reportBufferLen < ReportSize)
+		{
+			status = STATUS_INVALID_BUFFER_SIZE;
+			Trace(
+				TRACE_LEVEL_ERROR,
+				TRACE_DRIVER,
+				"%!FUNC! Report buffer is too small."
+			);
+			goto exit;
+		}
+
+		ReportLatencyRead(
+			&devContext->ReportContext,
+			(PREPORT_LATENCY_FEATURE_REPORT)featurePacket->reportBuffer);
+
+		break;
+	}
+	case REPORTID_COUNTERS:
+	{
+		// Size sanity check
+		ReportSize = sizeof(HID_COUNTERS_FEATURE_REPORT);
+		if (featurePacket->reportBufferLen < ReportSize)
+		{
+			status = STATUS_INVALID_BUFFER_SIZE;
+			Trace(
+				TRACE_LEVEL_ERROR,
+				TRACE_DRIVER,
+				"%!FUNC! Report buffer is too small."
+			);
+			goto exit;
+		}
+
+		PHID_COUNTERS_FEATURE_REPORT countersReport = (PHID_COUNTERS_FEATURE_REPORT)featurePacket->reportBuffer;
+
+		RtlZeroMemory(countersReport, sizeof(*countersReport));
+		countersReport->ReportID = REPORTID_COUNTERS;
+		countersReport->SpbTransfers = devContext->I2CContext.Transfers;
+		countersReport->SpbRejected = devContext->I2CContext.Rejected;
+
+		if (devContext->TouchContext != NULL)
+		{
+			FT5X_CONTROLLER_CONTEXT* controller = (FT5X_CONTROLLER_CONTEXT*)devContext->TouchContext;
+
+			countersReport->TouchFrameReads = controller->TouchFrameReads;
+			countersReport->TouchFrameSecondReads = controller->TouchFrameSecondReads;
+			countersReport->TouchFrameFullReads = controller->TouchFrameFullReads;
+		}
+
+		break;
+	}
+#if REPORT_TRACE_LEVEL > 0
+	case REPORTID_TRACE:
+	{
+		// Size sanity check
+		ReportSize = sizeof(REPORT_TRACE_FEATURE_REPORT);
+		if (featurePacket->reportBufferLen < ReportSize)
+		{
+			status = STATUS_INVALID_BUFFER_SIZE;
+			Trace(
+				TRACE_LEVEL_ERROR,
+				TRACE_DRIVER,
+				"%!FUNC! Report buffer is too small."
+			);
+			goto exit;
+		}
+
+		ReportTraceRead(
+			&devContext->ReportContext,
+			(PREPORT_TRACE_FEATURE_REPORT)featurePacket->reportBuffer);
+
+		break;
+	}
+#endif
 	default:
 	{
 		Trace(
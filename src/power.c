@@ -369,6 +369,11 @@ Return Value:
     //
     WdfWaitLockAcquire(controller->ControllerLock, NULL);
 
+    //
+    // Stop republishing the last frame before the cache is invalidated
+    //
+    ReportStopContinuousSimulation((PREPORT_CONTEXT)ReportContext);
+
     //
     // Put the chip in sleep mode
     //
@@ -391,12 +396,7 @@ Return Value:
     //
     // Invalidate state
     //
-    ((PREPORT_CONTEXT)ReportContext)->Cache.SlotValid = 0;
-    ((PREPORT_CONTEXT)ReportContext)->Cache.SlotDirty = 0;
-    ((PREPORT_CONTEXT)ReportContext)->Cache.DownCount = 0;
-    ((PREPORT_CONTEXT)ReportContext)->ButtonCache.ButtonSlots[0] = 0;
-    ((PREPORT_CONTEXT)ReportContext)->ButtonCache.ButtonSlots[1] = 0;
-    ((PREPORT_CONTEXT)ReportContext)->ButtonCache.ButtonSlots[2] = 0;
+    ReportResetContactState((PREPORT_CONTEXT)ReportContext);
 
 
     WdfWaitLockRelease(controller->ControllerLock);
@@ -59,7 +59,7 @@ static FT5X_CONFIGURATION gDefaultConfiguration =
     //
     {
         1,                                              // Reporting mode (throttle)
-        1,                                              // Abs position filter
+        0,                                              // Abs position filter (off)
         0,                                              // Rel position filter
         0,                                              // Rel ballistics
         0,                                              // Dribble
@@ -69,8 +69,8 @@ static FT5X_CONFIGURATION gDefaultConfiguration =
         0,                                              // ManTrackedFinger
         0,                                              // DeltaXPosThreshold
         0,                                              // DeltaYPosThreshold
-        0,                                              // Velocity
-        0,                                              // Acceleration
+        100,                                            // Velocity (prediction weight %)
+        50,                                             // Acceleration (prediction weight %)
         TOUCH_DEVICE_RESOLUTION_X,                      // Sensor Max X Position
         TOUCH_DEVICE_RESOLUTION_Y,                      // Sensor Max Y Position
         0x1e,                                           // ZTouchThreshold
@@ -100,10 +100,159 @@ static FT5X_CONFIGURATION gDefaultConfiguration =
     //
     // Internal driver settings
     //
+    0x0,                                                // Controller stays powered in D3
+    FT5X_TOUCH_READ_FULL,                               // Touch frame read mode
+    0x0,                                                // Send stationary reports
+    250,                                                // Stationary keep-alive (ms)
+    0,                                                  // Prediction horizon (ms, off)
+    24,                                                 // Prediction max distance (pixels)
+    0x0,                                                // Report contact size and pressure
+    0x0,                                                // Palm rejection (off)
+    0x0,                                                // Palm weight threshold (area only)
+    0,                                                  // Contacts per finger report (all)
+};
+
+//
+// Internal driver settings that can be overridden from the touch settings
+// key, offsets are relative to FT5X_CONFIGURATION
+//
+RTL_QUERY_REGISTRY_TABLE gConfigRegistryTable[] =
+{
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"TouchReadMode",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, TouchReadMode)),
+        REG_DWORD,
+        &gDefaultConfiguration.TouchReadMode,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"SuppressStationaryReports",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, SuppressStationaryReports)),
+        REG_DWORD,
+        &gDefaultConfiguration.SuppressStationaryReports,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"StationaryKeepAliveMs",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, StationaryKeepAliveMs)),
+        REG_DWORD,
+        &gDefaultConfiguration.StationaryKeepAliveMs,
+        sizeof(UINT32)
+    },
     {
-        0x0,                                            // Controller stays powered in D3
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"AbsPosFilt",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, TouchSettings.AbsPosFilt)),
+        REG_DWORD,
+        &gDefaultConfiguration.TouchSettings.AbsPosFilt,
+        sizeof(UINT32)
     },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"DeltaXPosThreshold",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, TouchSettings.DeltaXPosThreshold)),
+        REG_DWORD,
+        &gDefaultConfiguration.TouchSettings.DeltaXPosThreshold,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"DeltaYPosThreshold",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, TouchSettings.DeltaYPosThreshold)),
+        REG_DWORD,
+        &gDefaultConfiguration.TouchSettings.DeltaYPosThreshold,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"Velocity",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, TouchSettings.Velocity)),
+        REG_DWORD,
+        &gDefaultConfiguration.TouchSettings.Velocity,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"Acceleration",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, TouchSettings.Acceleration)),
+        REG_DWORD,
+        &gDefaultConfiguration.TouchSettings.Acceleration,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PredictionHorizonMs",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, PredictionHorizonMs)),
+        REG_DWORD,
+        &gDefaultConfiguration.PredictionHorizonMs,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PredictionMaxDistance",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, PredictionMaxDistance)),
+        REG_DWORD,
+        &gDefaultConfiguration.PredictionMaxDistance,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"ReportContactSize",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, ReportContactSize)),
+        REG_DWORD,
+        &gDefaultConfiguration.ReportContactSize,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PalmRejection",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, PalmRejection)),
+        REG_DWORD,
+        &gDefaultConfiguration.PalmRejection,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PalmDetectThreshold",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, TouchSettings.PalmDetectThreshold)),
+        REG_DWORD,
+        &gDefaultConfiguration.TouchSettings.PalmDetectThreshold,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PalmWeightThreshold",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, PalmWeightThreshold)),
+        REG_DWORD,
+        &gDefaultConfiguration.PalmWeightThreshold,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"ContactsPerReport",
+        (PVOID)(FIELD_OFFSET(FT5X_CONFIGURATION, ContactsPerReport)),
+        REG_DWORD,
+        &gDefaultConfiguration.ContactsPerReport,
+        sizeof(UINT32)
+    },
+    //
+    // List Terminator
+    //
+    {
+        NULL, 0,
+        NULL,
+        0,
+        REG_DWORD,
+        NULL,
+        0
+    }
 };
+static const ULONG gcbConfigRegistryTable = sizeof(gConfigRegistryTable);
+static const ULONG gcConfigRegistryTable =
+sizeof(gConfigRegistryTable) / sizeof(gConfigRegistryTable[0]);
 
 static TOUCH_SCREEN_SETTINGS gDefaultTouchSettings =
 {
@@ -1791,6 +1940,8 @@ TchRegistryGetControllerSettings(
 --*/
 {
     FT5X_CONTROLLER_CONTEXT* controller;
+    PRTL_QUERY_REGISTRY_TABLE regTable;
+    ULONG i;
     NTSTATUS status;
 
     UNREFERENCED_PARAMETER(FxDevice);
@@ -1802,8 +1953,66 @@ TchRegistryGetControllerSettings(
         &gDefaultConfiguration,
         sizeof(FT5X_CONFIGURATION));
 
-    status = STATUS_SUCCESS;
+    //
+    // Table passed to RtlQueryRegistryValues must be allocated 
+    // from NonPagedPool
+    //
+    regTable = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED,
+        gcbConfigRegistryTable,
+        TOUCH_POOL_TAG);
+
+    if (regTable == NULL)
+    {
+        //
+        // Defaults are already in place
+        //
+        status = STATUS_SUCCESS;
+        goto exit;
+    }
+
+    RtlCopyMemory(
+        regTable,
+        gConfigRegistryTable,
+        gcbConfigRegistryTable);
 
+    //
+    // Update offset values with base pointer
+    // 
+    for (i = 0; i < gcConfigRegistryTable - 1; i++)
+    {
+        regTable[i].EntryContext = (PVOID)(
+            ((SIZE_T)regTable[i].EntryContext) +
+            ((ULONG_PTR)&controller->Config));
+    }
+
+    //
+    // Populate the configuration with registry overrides (or defaults)
+    //
+    status = RtlQueryRegistryValues(
+        RTL_REGISTRY_ABSOLUTE,
+        TOUCH_REG_KEY L"\\" TOUCH_SCREEN_SETTINGS_SUB_KEY,
+        regTable,
+        NULL,
+        NULL);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_REGISTRY,
+            "Error retrieving driver configuration - 0x%08lX",
+            status);
+
+        //
+        // Missing overrides are not fatal, keep the defaults
+        //
+        status = STATUS_SUCCESS;
+    }
+
+    ExFreePoolWithTag(regTable, TOUCH_POOL_TAG);
+
+exit:
     return status;
 }
 
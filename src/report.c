@@ -26,187 +26,217 @@
 #include <HidCommon.h>
 #include <_spb.h>
 #include <report.h>
+#include <Cross Platform Shim\bitops.h>
+#include <Cross Platform Shim\hweight.h>
 #include <report.tmh>
 
-WDFTIMER  timerHandle;
-PREPORT_CONTEXT cachedReportContext = NULL;
-DETECTED_OBJECTS objectData;
+typedef struct _REPORT_TIMER_CONTEXT
+{
+	PREPORT_CONTEXT ReportContext;
+} REPORT_TIMER_CONTEXT, * PREPORT_TIMER_CONTEXT;
 
-NTSTATUS
-ReportWakeup(
-	IN PREPORT_CONTEXT ReportContext
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(REPORT_TIMER_CONTEXT, GetReportTimerContext)
+
+static PHID_TOUCH_FINGER
+ReportGetFinger(
+	IN PREPORT_CONTEXT ReportContext,
+	IN PHID_INPUT_REPORT HidReport,
+	IN ULONG Index
 )
 {
-	NTSTATUS status = STATUS_SUCCESS;
-	HID_INPUT_REPORT HidReport;
+	return (PHID_TOUCH_FINGER)((PUCHAR)&HidReport->TouchReport +
+		Index * ReportContext->FingerContactLength);
+}
 
-	RtlZeroMemory(&HidReport, sizeof(HID_INPUT_REPORT));
+static UCHAR
+ReportGetContactCount(
+	IN PREPORT_CONTEXT ReportContext,
+	IN PHID_INPUT_REPORT HidReport
+)
+{
+	return *((PUCHAR)&HidReport->TouchReport +
+		ReportContext->ContactsPerReport * ReportContext->FingerContactLength +
+		sizeof(USHORT));
+}
 
-	HidReport.ReportID = REPORTID_KEYPAD;
-	HidReport.KeyReport.ACBack = ReportContext->ButtonCache.ButtonSlots[0];
-	HidReport.KeyReport.Start = ReportContext->ButtonCache.ButtonSlots[1];
-	HidReport.KeyReport.ACSearch = ReportContext->ButtonCache.ButtonSlots[2];
-	HidReport.KeyReport.SystemPowerDown = 1;
+static BOOLEAN
+ReportCanCoalesce(
+	IN PREPORT_CONTEXT ReportContext,
+	IN PHID_INPUT_REPORT Pending,
+	IN PHID_INPUT_REPORT HidReport
+)
+/*++
 
-	status = TchSendReport(ReportContext->PingPongQueue, &HidReport);
+Routine Description:
 
-	if (!NT_SUCCESS(status))
-	{
-		Trace(
-			TRACE_LEVEL_ERROR,
-			TRACE_REPORTING,
-			"Error sending hid report for wake up (1) - 0x%08lX",
-			status);
+	A pending finger report can be replaced by a newer one when both only
+	move the same set of contacts that are all still down. Anything that
+	changes the contact set or lifts a contact is a transition and must be
+	delivered as is, and so are frames split over several reports.
 
-		goto exit;
-	}
+--*/
+{
+	UCHAR pendingCount;
+	UCHAR count;
+	ULONG i;
 
-	RtlZeroMemory(&HidReport, sizeof(HID_INPUT_REPORT));
+	if (Pending->ReportID != REPORTID_FINGER ||
+		HidReport->ReportID != REPORTID_FINGER)
+	{
+		return FALSE;
+	}
 
-	HidReport.ReportID = REPORTID_KEYPAD;
-	HidReport.KeyReport.ACBack = ReportContext->ButtonCache.ButtonSlots[0];
-	HidReport.KeyReport.Start = ReportContext->ButtonCache.ButtonSlots[1];
-	HidReport.KeyReport.ACSearch = ReportContext->ButtonCache.ButtonSlots[2];
-	HidReport.KeyReport.SystemPowerDown = 0;
+	pendingCount = ReportGetContactCount(ReportContext, Pending);
+	count = ReportGetContactCount(ReportContext, HidReport);
 
-	status = TchSendReport(ReportContext->PingPongQueue, &HidReport);
+	if (pendingCount == 0 ||
+		pendingCount != count ||
+		count > ReportContext->ContactsPerReport)
+	{
+		return FALSE;
+	}
 
-	if (!NT_SUCCESS(status))
+	for (i = 0; i < count; i++)
 	{
-		Trace(
-			TRACE_LEVEL_ERROR,
-			TRACE_REPORTING,
-			"Error sending hid report for wake up (2) - 0x%08lX",
-			status);
+		PHID_TOUCH_FINGER pending = ReportGetFinger(ReportContext, Pending, i);
+		PHID_TOUCH_FINGER current = ReportGetFinger(ReportContext, HidReport, i);
 
-		goto exit;
+		if (pending->ContactID != current->ContactID ||
+			!pending->TipSwitch ||
+			!current->TipSwitch)
+		{
+			return FALSE;
+		}
 	}
 
-exit:
-	return status;
+	return TRUE;
 }
 
-NTSTATUS
-ReportKeypad(
+static VOID
+ReportPackFingers(
 	IN PREPORT_CONTEXT ReportContext,
-	IN BOOLEAN Back,
-	IN BOOLEAN Start,
-	IN BOOLEAN Search
+	IN PHID_INPUT_REPORT HidReport,
+	IN UCHAR* Weights,
+	IN UCHAR* Areas,
+	OUT PHID_INPUT_REPORT Packed
 )
-{
-	NTSTATUS status = STATUS_SUCCESS;
-	HID_INPUT_REPORT HidReport;
+/*++
 
-	RtlZeroMemory(&HidReport, sizeof(HID_INPUT_REPORT));
+Routine Description:
 
-	HidReport.ReportID = REPORTID_KEYPAD;
-	HidReport.KeyReport.ACBack = Back;
-	HidReport.KeyReport.Start = Start;
-	HidReport.KeyReport.ACSearch = Search;
+	Converts a finger report to the layout of the report descriptor: the
+	configured number of contacts, each followed by its size and pressure
+	when contact size reporting is enabled, then the scan time and contact
+	count. The controller measures a single area, it is reported as both
+	width and height.
 
-	ReportContext->ButtonCache.ButtonSlots[0] = Back;
-	ReportContext->ButtonCache.ButtonSlots[1] = Start;
-	ReportContext->ButtonCache.ButtonSlots[2] = Search;
-	HidReport.KeyReport.SystemPowerDown = 0;
+--*/
+{
+	PUCHAR out = (PUCHAR)&Packed->TouchReport;
+	PHID_TOUCH_FINGER_EX contact;
+	ULONG i;
 
-	status = TchSendReport(ReportContext->PingPongQueue, &HidReport);
+	Packed->ReportID = HidReport->ReportID;
+#ifdef _TIMESTAMP_
+	Packed->TimeStamp = HidReport->TimeStamp;
+#endif
 
-	if (!NT_SUCCESS(status))
+	for (i = 0; i < ReportContext->ContactsPerReport; i++)
 	{
-		Trace(
-			TRACE_LEVEL_ERROR,
-			TRACE_REPORTING,
-			"Error sending hid report for keypad - 0x%08lX",
-			status);
+		contact = (PHID_TOUCH_FINGER_EX)out;
+		contact->Finger = HidReport->TouchReport.Contacts[i];
 
-		goto exit;
+		if (ReportContext->ContactSize)
+		{
+			contact->Width = (UCHAR)(Areas[i] & 0xF);
+			contact->Height = (UCHAR)(Areas[i] & 0xF);
+			contact->Pressure = Weights[i];
+		}
+
+		out += ReportContext->FingerContactLength;
 	}
 
-exit:
-	return status;
+	RtlCopyMemory(out, &HidReport->TouchReport.ScanTime, sizeof(USHORT));
+	out[sizeof(USHORT)] = HidReport->TouchReport.ContactCount;
 }
 
-NTSTATUS
-ReportPen(
+VOID
+ReportLatencyRecord(
 	IN PREPORT_CONTEXT ReportContext,
-	IN BOOLEAN TipSwitch,
-	IN BOOLEAN BarrelSwitch,
-	IN BOOLEAN Invert,
-	IN BOOLEAN Eraser,
-	IN BOOLEAN InRange,
-	IN USHORT  X,
-	IN USHORT  Y,
-	IN USHORT  TipPressure,
-	IN USHORT  XTilt,
-	IN USHORT  YTilt
+	IN REPORT_LATENCY_STAGE_ID Stage,
+	IN LONGLONG Ticks
 )
-{
-	NTSTATUS status;
-	HID_INPUT_REPORT HidReport;
-	RtlZeroMemory(&HidReport, sizeof(HID_INPUT_REPORT));
+/*++
 
-	USHORT ScratchX = (USHORT)X;
-	USHORT ScratchY = (USHORT)Y;
+Routine Description:
 
-	//
-	// Perform per-platform x/y adjustments to controller coordinates
-	//
-	TchTranslateToDisplayCoordinates(
-		&ScratchX,
-		&ScratchY,
-		&ReportContext->Props);
+	Adds a sample to the histogram of one interrupt service path stage.
+	Samples of a stage are only recorded from one place at a time, either
+	the interrupt service path or the report drainer.
 
-	HidReport.ReportID = REPORTID_STYLUS;
+Arguments:
 
-	HidReport.PenReport.InRange = InRange;
-	HidReport.PenReport.TipSwitch = TipSwitch;
-	HidReport.PenReport.Eraser = Eraser;
-	HidReport.PenReport.Invert = Invert;
-	HidReport.PenReport.BarrelSwitch = BarrelSwitch;
+	ReportContext - Report context holding the histograms
+	Stage - Stage the sample was taken for
+	Ticks - Duration of the stage in performance counter ticks
 
-	HidReport.PenReport.X = ScratchX;
-	HidReport.PenReport.Y = ScratchY;
-	HidReport.PenReport.TipPressure = TipPressure;
+Return Value:
 
-	HidReport.PenReport.XTilt = XTilt;
-	HidReport.PenReport.YTilt = YTilt;
+	None.
 
-	status = TchSendReport(ReportContext->PingPongQueue, &HidReport);
+--*/
+{
+	REPORT_LATENCY* Latency = &ReportContext->Latency;
+	REPORT_LATENCY_STAGE* stage = &Latency->Stages[Stage];
+	LARGE_INTEGER frequency;
+	ULONG bucket;
+	ULONG us;
 
-	if (!NT_SUCCESS(status))
+	if (Ticks < 0)
 	{
-		Trace(
-			TRACE_LEVEL_ERROR,
-			TRACE_REPORTING,
-			"Error sending hid report for active pen - 0x%08lX",
-			status);
+		return;
+	}
 
-		goto exit;
+	if (Latency->Frequency == 0)
+	{
+		KeQueryPerformanceCounter(&frequency);
+		Latency->Frequency = frequency.QuadPart;
 	}
 
-exit:
-	return status;
+	us = (ULONG)min((Ticks * 1000000) / Latency->Frequency, (LONGLONG)MAXULONG);
+	bucket = min((ULONG)RtlFindMostSignificantBit(us | 1), (ULONG)REPORT_LATENCY_BUCKETS - 1);
+
+	if (stage->Count == 0 || us < stage->MinUs)
+	{
+		stage->MinUs = us;
+	}
+
+	if (us > stage->MaxUs)
+	{
+		stage->MaxUs = us;
+	}
+
+	stage->Count++;
+	stage->Buckets[bucket]++;
 }
 
 VOID
-ReportUpdateLocalObjectCache(
-	IN DETECTED_OBJECTS* Data,
-	IN OBJECT_CACHE* Cache
+ReportLatencyRead(
+	IN PREPORT_CONTEXT ReportContext,
+	OUT PREPORT_LATENCY_FEATURE_REPORT Report
 )
 /*++
 
 Routine Description:
 
-	This routine takes raw data reported by the FocalTech hardware and
-	parses it to update a local cache of finger states. This routine manages
-	removing lifted touches from the cache, and manages a map between the
-	order of reported touches in hardware, and the order the driver should
-	use in reporting.
+	Fills the latency feature report with a snapshot of the stage
+	histograms and derives the 99th percentile of each from its buckets.
+	The histograms keep accumulating, they are not reset by the read.
 
 Arguments:
 
-	Data - A pointer to the new data returned from hardware
-	Cache - A data structure holding various current finger state info
+	ReportContext - Report context holding the histograms
+	Report - Receives the histograms
 
 Return Value:
 
@@ -214,191 +244,1353 @@ Return Value:
 
 --*/
 {
-	int i, j;
-
-	//
-	// When hardware was last read, if any slots reported as lifted, we
-	// must clean out the slot and old touch info. There may be new
-	// finger data using the slot.
-	//
-	for (i = 0; i < MAX_TOUCHES; i++)
+	REPORT_LATENCY_STAGE* stage;
+	ULONG threshold;
+	ULONG total;
+	ULONG i;
+	ULONG j;
+
+	RtlZeroMemory(Report, sizeof(*Report));
+	Report->ReportID = REPORTID_LATENCY;
+	Report->StageCount = REPORT_LATENCY_STAGES;
+	Report->BucketCount = REPORT_LATENCY_BUCKETS;
+
+	RtlCopyMemory(
+		Report->Stages,
+		ReportContext->Latency.Stages,
+		sizeof(Report->Stages));
+
+	for (i = 0; i < REPORT_LATENCY_STAGES; i++)
 	{
-		//
-		// Sweep for a slot that needs to be cleaned
-		//
-		if (!(Cache->SlotDirty & (1 << i)))
+		stage = &Report->Stages[i];
+
+		if (stage->Count == 0)
 		{
 			continue;
 		}
 
-		NT_ASSERT(Cache->DownCount > 0);
-
 		//
-		// Find the slot in the reporting list 
+		// The snapshot is not taken atomically, go by the bucket total
 		//
-		for (j = 0; j < MAX_TOUCHES; j++)
+		total = 0;
+		for (j = 0; j < REPORT_LATENCY_BUCKETS; j++)
 		{
-			if (Cache->DownOrder[j] == i)
-			{
-				break;
-			}
+			total += stage->Buckets[j];
 		}
 
-		NT_ASSERT(j != MAX_TOUCHES);
+		threshold = total - total / 100;
+		total = 0;
 
-		//
-		// Remove the slot. If the finger lifted was the last in the list,
-		// we just decrement the list total by one. If it was not last, we
-		// shift the trailing list items up by one.
-		//
-		for (; (j < Cache->DownCount - 1) && (j < MAX_TOUCHES - 1); j++)
+		for (j = 0; j < REPORT_LATENCY_BUCKETS - 1; j++)
 		{
-			Cache->DownOrder[j] = Cache->DownOrder[j + 1];
+			total += stage->Buckets[j];
+			if (total >= threshold)
+			{
+				break;
+			}
 		}
-		Cache->DownCount--;
 
-		//
-		// Finished, clobber the dirty bit
-		//
-		Cache->SlotDirty &= ~(1 << i);
+		stage->P99Us = j == REPORT_LATENCY_BUCKETS - 1 ?
+			stage->MaxUs :
+			min(2UL << j, stage->MaxUs);
 	}
+}
 
-	//
-	// Cache the new set of finger data reported by hardware
-	//
-	for (i = 0; i < MAX_TOUCHES; i++)
-	{
-		//
-		// Take actions when a new contact is first reported as down
-		//
-		if ((Data->States[i] != OBJECT_STATE_NOT_PRESENT) &&
-			((Cache->SlotValid & (1 << i)) == 0) &&
-			(Cache->DownCount < MAX_TOUCHES))
-		{
-			Cache->SlotValid |= (1 << i);
-			Cache->DownOrder[Cache->DownCount++] = i;
-		}
+#if REPORT_TRACE_LEVEL > 0
+VOID
+ReportTraceWrite(
+	IN REPORT_TRACE* Trace,
+	IN USHORT Event,
+	IN USHORT Arg0,
+	IN ULONG Arg1,
+	IN ULONG Arg2
+)
+/*++
 
-		//
-		// Ignore slots with no new information
-		//
-		if (!(Cache->SlotValid & (1 << i)))
-		{
-			continue;
-		}
+Routine Description:
 
-		//
-		// When finger is down, update local cache with new information from
-		// the controller. When finger is up, we'll use last cached value
-		//
-		Cache->Slot[i].status = (UCHAR)Data->States[i];
-		if (Cache->Slot[i].status)
-		{
-			Cache->Slot[i].x = Data->Positions[i].X;
-			Cache->Slot[i].y = Data->Positions[i].Y;
-		}
+	Appends a record to the trace ring. Writers only contend on the
+	record counter; a record is marked incomplete while it is written so
+	that a concurrent read can tell it apart.
 
-		//
-		// If a finger lifted, note the slot is now inactive so that any
-		// cached data is cleaned out before we read hardware again.
-		//
-		if (Cache->Slot[i].status == OBJECT_STATE_NOT_PRESENT)
-		{
-			Cache->SlotDirty |= (1 << i);
-			Cache->SlotValid &= ~(1 << i);
-		}
-	}
+Arguments:
 
-	//
-	// Get current scan time (in 100us units)
-	//
-	ULONG64 QpcTimeStamp;
-	Cache->ScanTime = KeQueryInterruptTimePrecise(&QpcTimeStamp) / 1000;
+	Trace - Trace ring of the device
+	Event - REPORT_TRACE_EVENT_XXX
+	Arg0, Arg1, Arg2 - Event specific arguments
+
+Return Value:
+
+	None.
+
+--*/
+{
+	REPORT_TRACE_RECORD* record;
+	ULONG sequence;
+
+	sequence = (ULONG)InterlockedIncrement(&Trace->Written);
+	record = &Trace->Records[(sequence - 1) & (REPORT_TRACE_RING_SIZE - 1)];
+
+	WriteULongRelease(&record->Sequence, 0);
+	KeMemoryBarrier();
+
+	record->Timestamp = KeQueryPerformanceCounter(NULL).QuadPart;
+	record->Event = Event;
+	record->Arg0 = Arg0;
+	record->Arg1 = Arg1;
+	record->Arg2 = Arg2;
+
+	WriteULongRelease(&record->Sequence, sequence);
 }
 
-NTSTATUS
-ReportObjectsInternal(
+VOID
+ReportTraceRead(
 	IN PREPORT_CONTEXT ReportContext,
-	IN DETECTED_OBJECTS data
+	OUT PREPORT_TRACE_FEATURE_REPORT Report
 )
 /*++
 
 Routine Description:
 
-	Called when a touch interrupt needs service.
+	Fills the trace feature report with the records following the ones
+	returned by the previous read. Records that were overwritten before
+	they could be read are counted as lost.
 
 Arguments:
 
-	ControllerContext - Touch controller context
-	SpbContext - A pointer to the current SPB context (I2C, etc)
-	HidReport- Buffer to fill with a hid report if touch data is available
-	InputMode - Specifies mouse, single-touch, or multi-touch reporting modes
-	PendingTouches - Notifies caller if there are more touches to report, to
-		complete reporting the full state of fingers on the screen
+	ReportContext - Report context holding the trace ring
+	Report - Receives the records
 
 Return Value:
 
-	NTSTATUS indicating whether or not the current hid report buffer was filled
+	None.
 
-	PendingTouches also indicates whether the caller should expect more than
-		one request to be completed to indicate the full state of fingers on
-		the screen
 --*/
 {
-	NTSTATUS status = STATUS_SUCCESS;
-	HID_INPUT_REPORT HidReport;
-	int TouchesReported = 0;
-	int currentFingerIndex;
-	int fingersToReport = 0;
-	USHORT SctatchX = 0, ScratchY = 0;
-	BOOLEAN HasPen = FALSE;
+	REPORT_TRACE* trace = &ReportContext->Trace;
+	REPORT_TRACE_RECORD* record;
+	LARGE_INTEGER frequency;
+	ULONG sequence;
+	ULONG written;
+	ULONG cursor;
+	ULONG first;
+	ULONG count;
+	ULONG lost;
+	ULONG i;
+
+	KeQueryPerformanceCounter(&frequency);
 
 	//
-	// Process the new touch data by updating our cached state
+	// Claim the records to return, reads may run in parallel
 	//
-	ReportUpdateLocalObjectCache(
-		&data,
-		&ReportContext->Cache);
+	do
+	{
+		written = (ULONG)ReadAcquire(&trace->Written);
+		cursor = (ULONG)ReadAcquire(&trace->ReadCursor);
 
+		first = cursor;
+		lost = 0;
+
+		if (written - cursor > REPORT_TRACE_RING_SIZE)
+		{
+			first = written - REPORT_TRACE_RING_SIZE;
+			lost = first - cursor;
+		}
+
+		count = min(written - first, (ULONG)REPORT_TRACE_RECORDS_PER_REPORT);
+	} while ((ULONG)InterlockedCompareExchange(
+		&trace->ReadCursor,
+		(LONG)(first + count),
+		(LONG)cursor) != cursor);
+
+	RtlZeroMemory(Report, sizeof(*Report));
+	Report->ReportID = REPORTID_TRACE;
+	Report->Count = (UCHAR)count;
+	Report->Lost = (USHORT)min(lost, (ULONG)MAXUSHORT);
+	Report->Written = written;
+	Report->Frequency = frequency.QuadPart;
+
+	for (i = 0; i < count; i++)
+	{
+		record = &trace->Records[(first + i) & (REPORT_TRACE_RING_SIZE - 1)];
+		sequence = ReadULongAcquire(&record->Sequence);
+
+		RtlCopyMemory(&Report->Records[i], record, sizeof(*record));
+		KeMemoryBarrier();
+
+		//
+		// Overwritten or still being written while it was copied
+		//
+		if (sequence != first + i + 1 ||
+			ReadULongAcquire(&record->Sequence) != sequence)
+		{
+			sequence = 0;
+		}
+
+		Report->Records[i].Sequence = sequence;
+	}
+}
+#endif
+
+NTSTATUS
+ReportQueueHidReport(
+	IN PREPORT_CONTEXT ReportContext,
+	IN PHID_INPUT_REPORT HidReport
+)
+/*++
+
+Routine Description:
+
+	Queues a report for HIDClass and completes as many pending reports as
+	there are read requests. When no request is posted the report waits in
+	the ring instead of being dropped; consecutive finger moves replace each
+	other while waiting.
+
+Arguments:
+
+	ReportContext - Report context holding the ring
+	HidReport - The report to deliver
+
+Return Value:
+
+	NTSTATUS, failure only if the ring is full and the report was dropped
+
+--*/
+{
+	REPORT_RING* ring = &ReportContext->PendingReports;
+	REPORT_RING_ENTRY* entry;
+	NTSTATUS status = STATUS_SUCCESS;
+	LONG head = ring->Head;
+	LONG tail = ReadAcquire(&ring->Tail);
+	ULONG depth;
+	ULONG length;
+
+	//
+	// Only the bytes that go on the wire are copied
+	//
+	length = HidReport->ReportID == REPORTID_FINGER ?
+		ReportContext->FingerReportLength :
+		(ULONG)HID_INPUT_REPORT_LENGTH;
+
+	//
+	// Try to fold a finger move into the newest pending report. The CAS
+	// fails if the report is being completed or was already completed.
+	//
+	if (head != tail)
+	{
+		entry = &ring->Entries[(head - 1) & (REPORT_RING_SIZE - 1)];
+
+		if (ReportCanCoalesce(ReportContext, &entry->Report, HidReport) &&
+			InterlockedCompareExchange(&entry->State, REPORT_RING_ENTRY_UPDATING, REPORT_RING_ENTRY_READY) == REPORT_RING_ENTRY_READY)
+		{
+			RtlCopyMemory(&entry->Report, HidReport, length);
+			entry->InterruptTime = ReportContext->Latency.FrameInterruptTime;
+			entry->DecodeTime = ReportContext->Latency.FrameDecodeTime;
+			InterlockedExchange(&entry->State, REPORT_RING_ENTRY_READY);
+			ring->Coalesced++;
+			goto drain;
+		}
+	}
+
+	if (head - tail >= REPORT_RING_SIZE)
+	{
+		ring->Dropped++;
+		status = STATUS_DEVICE_BUSY;
+
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_REPORTING,
+			"Pending report ring full, dropping report (dropped: %lu)",
+			ring->Dropped);
+
+		goto drain;
+	}
+
+	entry = &ring->Entries[head & (REPORT_RING_SIZE - 1)];
+	RtlCopyMemory(&entry->Report, HidReport, length);
+	entry->Length = length;
+	entry->InterruptTime = ReportContext->Latency.FrameInterruptTime;
+	entry->DecodeTime = ReportContext->Latency.FrameDecodeTime;
+	InterlockedExchange(&entry->State, REPORT_RING_ENTRY_READY);
+	InterlockedExchange(&ring->Head, head + 1);
+
+	depth = (ULONG)(head + 1 - tail);
+	if (depth > ring->MaxDepth)
+	{
+		ring->MaxDepth = depth;
+	}
+
+drain:
+	ReportDrainPendingReports(ReportContext);
+
+	return status;
+}
+
+VOID
+ReportDrainPendingReports(
+	IN PREPORT_CONTEXT ReportContext
+)
+/*++
+
+Routine Description:
+
+	Completes pending reports in order for as long as HIDClass has read
+	requests posted. Called after a report was queued and whenever a new
+	read request arrives. Only one caller drains at a time; a caller that
+	finds the ring busy leaves a request behind that the current drainer
+	picks up before it lets go.
+
+Arguments:
+
+	ReportContext - Report context holding the ring
+
+Return Value:
+
+	None.
+
+--*/
+{
+	REPORT_RING* ring = &ReportContext->PendingReports;
+	REPORT_RING_ENTRY* entry;
+	NTSTATUS status;
+	LONGLONG completeTime;
+	LONG requests;
+	LONG flushes;
+	LONG tail;
+
+	InterlockedIncrement(&ring->DrainRequests);
+
+	for (;;)
+	{
+		if (InterlockedCompareExchange(&ring->Draining, 1, 0) != 0)
+		{
+			return;
+		}
+
+		requests = ReadAcquire(&ring->DrainRequests);
+		flushes = ReadAcquire(&ring->FlushRequests);
+
+		for (tail = ring->Tail; tail != ReadAcquire(&ring->Head); tail++)
+		{
+			entry = &ring->Entries[tail & (REPORT_RING_SIZE - 1)];
+
+			//
+			// The producer may be folding a move into this entry, it
+			// drains again once it is done
+			//
+			if (InterlockedCompareExchange(&entry->State, REPORT_RING_ENTRY_CLAIMED, REPORT_RING_ENTRY_READY) != REPORT_RING_ENTRY_READY)
+			{
+				break;
+			}
+
+			if (flushes != ring->FlushesDone)
+			{
+				InterlockedExchange(&entry->State, REPORT_RING_ENTRY_FREE);
+				InterlockedExchange(&ring->Tail, tail + 1);
+				continue;
+			}
+
+			status = TchSendReport(
+				ReportContext->PingPongQueue,
+				&entry->Report,
+				entry->Length);
+			if (status == STATUS_NO_MORE_ENTRIES)
+			{
+				InterlockedExchange(&entry->State, REPORT_RING_ENTRY_READY);
+				break;
+			}
+
+			if (NT_SUCCESS(status) && entry->InterruptTime != 0)
+			{
+				completeTime = KeQueryPerformanceCounter(NULL).QuadPart;
+
+				ReportLatencyRecord(
+					ReportContext,
+					REPORT_LATENCY_STAGE_COMPLETE,
+					completeTime - entry->DecodeTime);
+				ReportLatencyRecord(
+					ReportContext,
+					REPORT_LATENCY_STAGE_TOTAL,
+					completeTime - entry->InterruptTime);
+			}
+
+			ReportTraceInformation(
+				ReportContext,
+				REPORT_TRACE_EVENT_REPORT_SENT,
+				(USHORT)(entry->Report.ReportID |
+					(entry->Report.ReportID == REPORTID_FINGER ?
+						ReportGetContactCount(ReportContext, &entry->Report) << 8 : 0)),
+				entry->Length,
+				(ULONG)status);
+
+			InterlockedExchange(&entry->State, REPORT_RING_ENTRY_FREE);
+			InterlockedExchange(&ring->Tail, tail + 1);
+		}
+
+		//
+		// The flush is only done once nothing is left behind
+		//
+		if (tail == ReadAcquire(&ring->Head))
+		{
+			ring->FlushesDone = flushes;
+		}
+
+		InterlockedExchange(&ring->Draining, 0);
+
+		//
+		// Nobody asked for another pass while we were draining
+		//
+		if (ReadAcquire(&ring->DrainRequests) == requests)
+		{
+			return;
+		}
+	}
+}
+
+VOID
+ReportFlushPendingReports(
+	IN PREPORT_CONTEXT ReportContext
+)
+/*++
+
+Routine Description:
+
+	Discards pending reports, used when the device powers down so stale
+	input is not delivered on resume. A drain in progress carries out the
+	flush before it lets go of the ring.
+
+--*/
+{
+	InterlockedIncrement(&ReportContext->PendingReports.FlushRequests);
+
+	ReportDrainPendingReports(ReportContext);
+}
+
+VOID
+ReportResetContactState(
+	IN PREPORT_CONTEXT ReportContext
+)
+/*++
+
+Routine Description:
+
+	Forgets every contact and button along with the per-slot state each
+	processing stage keeps for them, and discards pending reports. Used when
+	the device powers down, so a contact seen after resume starts fresh in
+	every stage.
+
+--*/
+{
+	ReportContext->Cache.SlotValid = 0;
+	ReportContext->Cache.SlotDirty = 0;
+	ReportContext->Cache.DownCount = 0;
+	ReportContext->ButtonCache.ButtonSlots[0] = 0;
+	ReportContext->ButtonCache.ButtonSlots[1] = 0;
+	ReportContext->ButtonCache.ButtonSlots[2] = 0;
+	ReportContext->Suppression.LastReport.ContactCount = 0;
+	ReportContext->Filter.SlotValid = 0;
+	ReportContext->Predictor.SlotValid = 0;
+	ReportContext->Palm.SlotValid = 0;
+
+	ReportFlushPendingReports(ReportContext);
+}
+
+NTSTATUS
+ReportWakeup(
+	IN PREPORT_CONTEXT ReportContext
+)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	HID_INPUT_REPORT HidReport;
+
+	RtlZeroMemory(&HidReport, sizeof(HID_INPUT_REPORT));
+
+	HidReport.ReportID = REPORTID_KEYPAD;
+	HidReport.KeyReport.ACBack = ReportContext->ButtonCache.ButtonSlots[0];
+	HidReport.KeyReport.Start = ReportContext->ButtonCache.ButtonSlots[1];
+	HidReport.KeyReport.ACSearch = ReportContext->ButtonCache.ButtonSlots[2];
+	HidReport.KeyReport.SystemPowerDown = 1;
+
+	status = ReportQueueHidReport(ReportContext, &HidReport);
+
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_REPORTING,
+			"Error sending hid report for wake up (1) - 0x%08lX",
+			status);
+
+		goto exit;
+	}
+
+	RtlZeroMemory(&HidReport, sizeof(HID_INPUT_REPORT));
+
+	HidReport.ReportID = REPORTID_KEYPAD;
+	HidReport.KeyReport.ACBack = ReportContext->ButtonCache.ButtonSlots[0];
+	HidReport.KeyReport.Start = ReportContext->ButtonCache.ButtonSlots[1];
+	HidReport.KeyReport.ACSearch = ReportContext->ButtonCache.ButtonSlots[2];
+	HidReport.KeyReport.SystemPowerDown = 0;
+
+	status = ReportQueueHidReport(ReportContext, &HidReport);
+
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_REPORTING,
+			"Error sending hid report for wake up (2) - 0x%08lX",
+			status);
+
+		goto exit;
+	}
+
+exit:
+	return status;
+}
+
+NTSTATUS
+ReportKeypad(
+	IN PREPORT_CONTEXT ReportContext,
+	IN BOOLEAN Back,
+	IN BOOLEAN Start,
+	IN BOOLEAN Search
+)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	HID_INPUT_REPORT HidReport;
+
+	RtlZeroMemory(&HidReport, sizeof(HID_INPUT_REPORT));
+
+	HidReport.ReportID = REPORTID_KEYPAD;
+	HidReport.KeyReport.ACBack = Back;
+	HidReport.KeyReport.Start = Start;
+	HidReport.KeyReport.ACSearch = Search;
+
+	ReportContext->ButtonCache.ButtonSlots[0] = Back;
+	ReportContext->ButtonCache.ButtonSlots[1] = Start;
+	ReportContext->ButtonCache.ButtonSlots[2] = Search;
+	HidReport.KeyReport.SystemPowerDown = 0;
+
+	status = ReportQueueHidReport(ReportContext, &HidReport);
+
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_REPORTING,
+			"Error sending hid report for keypad - 0x%08lX",
+			status);
+
+		goto exit;
+	}
+
+exit:
+	return status;
+}
+
+NTSTATUS
+ReportPen(
+	IN PREPORT_CONTEXT ReportContext,
+	IN BOOLEAN TipSwitch,
+	IN BOOLEAN BarrelSwitch,
+	IN BOOLEAN Invert,
+	IN BOOLEAN Eraser,
+	IN BOOLEAN InRange,
+	IN USHORT  X,
+	IN USHORT  Y,
+	IN USHORT  TipPressure,
+	IN USHORT  XTilt,
+	IN USHORT  YTilt
+)
+{
+	NTSTATUS status;
+	HID_INPUT_REPORT HidReport;
+	RtlZeroMemory(&HidReport, sizeof(HID_INPUT_REPORT));
+
+	USHORT ScratchX = (USHORT)X;
+	USHORT ScratchY = (USHORT)Y;
+
+	//
+	// Perform per-platform x/y adjustments to controller coordinates
+	//
+	TchTransformToDisplayCoordinates(
+		&ScratchX,
+		&ScratchY,
+		1,
+		&ReportContext->Props);
+
+	HidReport.ReportID = REPORTID_STYLUS;
+
+	HidReport.PenReport.InRange = InRange;
+	HidReport.PenReport.TipSwitch = TipSwitch;
+	HidReport.PenReport.Eraser = Eraser;
+	HidReport.PenReport.Invert = Invert;
+	HidReport.PenReport.BarrelSwitch = BarrelSwitch;
+
+	HidReport.PenReport.X = ScratchX;
+	HidReport.PenReport.Y = ScratchY;
+	HidReport.PenReport.TipPressure = TipPressure;
+
+	HidReport.PenReport.XTilt = XTilt;
+	HidReport.PenReport.YTilt = YTilt;
+
+	status = ReportQueueHidReport(ReportContext, &HidReport);
+
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_REPORTING,
+			"Error sending hid report for active pen - 0x%08lX",
+			status);
+
+		goto exit;
+	}
+
+exit:
+	return status;
+}
+
+VOID
+ReportRemoveLiftedObjects(
+	IN OBJECT_CACHE* Cache
+)
+/*++
+
+Routine Description:
+
+	Removes slots that were reported as lifted from the reporting order.
+	This runs right after the lift has been reported so the contact does
+	not linger in the cache until the next frame.
+
+Arguments:
+
+	Cache - A data structure holding various current finger state info
+
+Return Value:
+
+	None.
+
+--*/
+{
+	unsigned long dirty = Cache->SlotDirty;
+	unsigned long i;
+	ULONGLONG match;
+	ULONGLONG lowMask;
+	int j;
+
+	//
+	// Visit only the slots that need to be cleaned
+	//
+	for (i = find_first_bit(&dirty, MAX_TOUCHES);
+		i < MAX_TOUCHES;
+		i = find_next_bit(&dirty, MAX_TOUCHES, i + 1))
+	{
+		NT_ASSERT(Cache->DownCount > 0);
+
+		//
+		// Find the slot in the reporting list: XOR turns the matching
+		// nibble into zero, and the zero nibble test flags it in bit 3 of
+		// that nibble. Borrows only produce false hits above the first
+		// real one, so the lowest flagged nibble is the slot.
+		//
+		match = Cache->DownQueue ^ (i * 0x1111111111111111ULL);
+		match = (match - 0x1111111111111111ULL) & ~match & 0x8888888888888888ULL;
+		match &= (1ULL << (4 * Cache->DownCount)) - 1;
+
+		NT_ASSERT(match != 0);
+
+		j = RtlFindLeastSignificantBit(match) / 4;
+
+		//
+		// Remove the slot by shifting the trailing nibbles down by one
+		//
+		lowMask = (1ULL << (4 * j)) - 1;
+		Cache->DownQueue = (Cache->DownQueue & lowMask) | ((Cache->DownQueue >> 4) & ~lowMask);
+		Cache->DownCount--;
+	}
+
+	//
+	// Finished, clobber the dirty bits
+	//
+	Cache->SlotDirty = 0;
+}
+
+VOID
+ReportUpdateLocalObjectCache(
+	IN DETECTED_OBJECTS* Data,
+	IN OBJECT_CACHE* Cache
+)
+/*++
+
+Routine Description:
+
+	This routine takes raw data reported by the FocalTech hardware and
+	parses it to update a local cache of finger states. This routine manages
+	removing lifted touches from the cache, and manages a map between the
+	order of reported touches in hardware, and the order the driver should
+	use in reporting.
+
+Arguments:
+
+	Data - A pointer to the new data returned from hardware
+	Cache - A data structure holding various current finger state info
+
+Return Value:
+
+	None.
+
+--*/
+{
+	unsigned long present = 0;
+	unsigned long arrived;
+	unsigned long valid;
+	unsigned long i;
+
+	//
+	// Lifted slots are normally removed as soon as the lift was reported,
+	// clean up any that are left over from a report that failed to send
+	//
+	ReportRemoveLiftedObjects(Cache);
+
+	for (i = 0; i < MAX_TOUCHES; i++)
+	{
+		present |= (unsigned long)(Data->States[i] != OBJECT_STATE_NOT_PRESENT) << i;
+	}
+
+	//
+	// Take actions when a new contact is first reported as down
+	//
+	arrived = present & ~Cache->SlotValid;
+	for (i = find_first_bit(&arrived, MAX_TOUCHES);
+		i < MAX_TOUCHES && Cache->DownCount < MAX_TOUCHES;
+		i = find_next_bit(&arrived, MAX_TOUCHES, i + 1))
+	{
+		Cache->SlotValid |= (1 << i);
+		Cache->DownQueue = (Cache->DownQueue & ~(0xFULL << (4 * Cache->DownCount))) |
+			((ULONGLONG)i << (4 * Cache->DownCount));
+		Cache->DownCount++;
+	}
+
+	//
+	// Cache the new set of finger data reported by hardware, slots with no
+	// new information are skipped
+	//
+	valid = Cache->SlotValid;
+	for (i = find_first_bit(&valid, MAX_TOUCHES);
+		i < MAX_TOUCHES;
+		i = find_next_bit(&valid, MAX_TOUCHES, i + 1))
+	{
+		//
+		// When finger is down, update local cache with new information from
+		// the controller. When finger is up, we'll use last cached value
+		// unless the controller reported where it lifted
+		//
+		Cache->Slot[i].status = (UCHAR)Data->States[i];
+		if (Cache->Slot[i].status || (Data->Lifted & (1 << i)))
+		{
+			Cache->Slot[i].x = Data->Positions[i].X;
+			Cache->Slot[i].y = Data->Positions[i].Y;
+		}
+		if (Cache->Slot[i].status)
+		{
+			Cache->Slot[i].weight = Data->Weights[i];
+			Cache->Slot[i].area = Data->Areas[i];
+		}
+	}
+
+	//
+	// If a finger lifted, note the slot is now inactive so that any
+	// cached data is cleaned out once the lift has been reported
+	//
+	Cache->SlotDirty |= valid & ~present;
+	Cache->SlotValid &= present;
+
+	NT_ASSERT((int)hweight32(Cache->SlotValid | Cache->SlotDirty) == Cache->DownCount);
+
+	//
+	// Scan time of the frame (in 100us units), split to avoid overflowing
+	// the multiplication on long uptimes
+	//
+	LARGE_INTEGER frequency;
+	KeQueryPerformanceCounter(&frequency);
+	Cache->ScanTime =
+		(Data->Timestamp.QuadPart / frequency.QuadPart) * 10000 +
+		((Data->Timestamp.QuadPart % frequency.QuadPart) * 10000) / frequency.QuadPart;
+}
+
+static LONGLONG
+ReportFilterAlpha(
+	IN ULONG Cutoff,
+	IN ULONG IntervalUs
+)
+/*++
+
+Routine Description:
+
+	Smoothing factor of a first order low-pass, 1 / (1 + 1 / (2 pi fc Te)),
+	in 1/65536 units. The cutoff is in millihertz, so 2 pi fc Te is scaled
+	by 10^12.
+
+--*/
+{
+	ULONGLONG w;
+
+	w = 6283ULL * min(Cutoff, REPORT_FILTER_MAX_CUTOFF) * IntervalUs;
+
+	return (LONGLONG)((w << 16) / (w + 1000000000000ULL));
+}
+
+static VOID
+ReportFilterAxis(
+	IN REPORT_FILTER* Filter,
+	IN OUT LONGLONG* Position,
+	IN OUT LONGLONG* Speed,
+	IN int Raw,
+	IN ULONG IntervalUs,
+	IN LONGLONG DerivativeAlpha
+)
+{
+	LONGLONG delta = ((LONGLONG)Raw << 8) - *Position;
+	LONGLONG speed = (delta * 1000000) / IntervalUs;
+	ULONG cutoff;
+
+	//
+	// Smooth the speed, then open the position cutoff up with it so fast
+	// strokes are followed with little lag while resting fingers are
+	// smoothed hard
+	//
+	*Speed += ((speed - *Speed) * DerivativeAlpha) / 65536;
+
+	cutoff = Filter->MinCutoff +
+		(ULONG)min((Filter->Beta * (ULONGLONG)(_abs64(*Speed) >> 8)) / 10,
+			REPORT_FILTER_MAX_CUTOFF);
+
+	*Position += (delta * ReportFilterAlpha(cutoff, IntervalUs)) / 65536;
+}
+
+static VOID
+ReportFilterObjects(
+	IN REPORT_FILTER* Filter,
+	IN OBJECT_CACHE* Cache,
+	IN LONGLONG Timestamp
+)
+/*++
+
+Routine Description:
+
+	Runs the cached positions of this frame through a per-slot 1 euro
+	filter and replaces them with the filtered positions. Contacts that
+	just went down start from their raw position.
+
+Arguments:
+
+	Filter - Filter state
+	Cache - Local object cache, updated with this frame's positions
+	Timestamp - Performance counter value of the frame
+
+Return Value:
+
+	None.
+
+--*/
+{
+	unsigned long live = Cache->SlotValid | Cache->SlotDirty;
+	LONGLONG derivativeAlpha;
+	LONGLONG interval;
+	ULONG intervalUs;
+	unsigned long i;
+
+	if (!Filter->Enabled)
+	{
+		return;
+	}
+
+	interval = min(max(Timestamp - Filter->LastTimestamp, 0), Filter->Frequency);
+	intervalUs = (ULONG)min(
+		(interval * 1000000) / Filter->Frequency,
+		REPORT_FILTER_MAX_INTERVAL_US);
+	Filter->LastTimestamp = Timestamp;
+
+	derivativeAlpha = ReportFilterAlpha(REPORT_FILTER_DERIVATIVE_CUTOFF, intervalUs);
+
+	for (i = find_first_bit(&live, MAX_TOUCHES);
+		i < MAX_TOUCHES;
+		i = find_next_bit(&live, MAX_TOUCHES, i + 1))
+	{
+		REPORT_FILTER_SLOT* slot = &Filter->Slot[i];
+
+		if (!(Filter->SlotValid & (1 << i)))
+		{
+			slot->X = (LONGLONG)Cache->Slot[i].x << 8;
+			slot->Y = (LONGLONG)Cache->Slot[i].y << 8;
+			slot->SpeedX = 0;
+			slot->SpeedY = 0;
+		}
+		else if (intervalUs != 0)
+		{
+			ReportFilterAxis(Filter, &slot->X, &slot->SpeedX, Cache->Slot[i].x, intervalUs, derivativeAlpha);
+			ReportFilterAxis(Filter, &slot->Y, &slot->SpeedY, Cache->Slot[i].y, intervalUs, derivativeAlpha);
+		}
+
+		Cache->Slot[i].x = (int)((slot->X + 128) >> 8);
+		Cache->Slot[i].y = (int)((slot->Y + 128) >> 8);
+	}
+
+	//
+	// Lifted slots are dropped once reported, a new contact in the same
+	// slot must not inherit their state
+	//
+	Filter->SlotValid = Cache->SlotValid;
+}
+
+static LONGLONG
+ReportPredictAxis(
+	IN REPORT_PREDICTOR* Predictor,
+	IN REPORT_PREDICTOR_SLOT* Slot,
+	IN OUT LONGLONG* Position,
+	IN OUT LONGLONG* Velocity,
+	IN OUT LONGLONG* Acceleration,
+	IN int Current,
+	IN ULONG IntervalUs
+)
+{
+	LONGLONG position = (LONGLONG)Current << 8;
+	LONGLONG velocity;
+	LONGLONG acceleration;
+	LONGLONG offset;
+
+	if (IntervalUs != 0)
+	{
+		//
+		// Estimates from consecutive samples are noisy, keep running
+		// averages. Acceleration needs two velocities before it means
+		// anything
+		//
+		velocity = ((position - *Position) * 1000000) / IntervalUs;
+		if (Slot->Samples >= 2)
+		{
+			acceleration = ((velocity - *Velocity) * 1000000) / IntervalUs;
+			*Acceleration = Slot->Samples >= 3 ?
+				*Acceleration + (acceleration - *Acceleration) / 4 : acceleration;
+		}
+
+		*Velocity = Slot->Samples >= 2 ? *Velocity + (velocity - *Velocity) / 2 : velocity;
+	}
+
+	*Position = position;
+
+	if (Slot->Samples < 1)
+	{
+		return position;
+	}
+
+	//
+	// Extrapolate p + v h + a h^2 / 2 with each term weighted, and keep the
+	// jump within the configured distance since a bad estimate is worse
+	// than latency
+	//
+	offset = (*Velocity * Predictor->HorizonUs / 1000000) * Predictor->VelocityGain / 100;
+
+	if (Slot->Samples >= 3)
+	{
+		offset += ((*Acceleration * Predictor->HorizonUs / 1000000) *
+			Predictor->HorizonUs / 2000000) * Predictor->AccelerationGain / 100;
+	}
+
+	offset = min(max(offset, -Predictor->MaxDistance), Predictor->MaxDistance);
+
+	return min(max(position + offset, 0), (LONGLONG)MAXUSHORT << 8);
+}
+
+static VOID
+ReportPredictObjects(
+	IN REPORT_PREDICTOR* Predictor,
+	IN OBJECT_CACHE* Cache,
+	IN UINT32 Lifted,
+	IN LONGLONG Timestamp
+)
+/*++
+
+Routine Description:
+
+	Replaces the cached positions of contacts that are down with where
+	they are expected to be a horizon ahead. Lifted contacts are reported
+	where they actually lifted.
+
+Arguments:
+
+	Predictor - Predictor state
+	Cache - Local object cache, updated and filtered for this frame
+	Lifted - Slots the controller reported a lift position for
+	Timestamp - Performance counter value of the frame
+
+Return Value:
+
+	None.
+
+--*/
+{
+	unsigned long live = Cache->SlotValid | Cache->SlotDirty;
+	LONGLONG interval;
+	ULONG intervalUs;
+	unsigned long i;
+
+	if (!Predictor->Enabled)
+	{
+		return;
+	}
+
+	interval = min(max(Timestamp - Predictor->LastTimestamp, 0), Predictor->Frequency);
+	intervalUs = (ULONG)((interval * 1000000) / Predictor->Frequency);
+
+	//
+	// Frames closer together than this are re-sends or bursts, they would
+	// only amplify noise
+	//
+	if (intervalUs < REPORT_PREDICTOR_MIN_INTERVAL_US)
+	{
+		intervalUs = 0;
+	}
+	else
+	{
+		Predictor->LastTimestamp = Timestamp;
+	}
+
+	for (i = find_first_bit(&live, MAX_TOUCHES);
+		i < MAX_TOUCHES;
+		i = find_next_bit(&live, MAX_TOUCHES, i + 1))
+	{
+		REPORT_PREDICTOR_SLOT* slot = &Predictor->Slot[i];
+		LONGLONG x;
+		LONGLONG y;
+
+		if (!(Predictor->SlotValid & (1 << i)))
+		{
+			RtlZeroMemory(slot, sizeof(*slot));
+		}
+
+		//
+		// A lift without a position would otherwise repeat the last
+		// prediction, put it back where the contact actually was
+		//
+		if (Cache->SlotDirty & (1 << i))
+		{
+			if (!(Lifted & (1 << i)) && slot->Samples != 0)
+			{
+				Cache->Slot[i].x = (int)(slot->X >> 8);
+				Cache->Slot[i].y = (int)(slot->Y >> 8);
+			}
+
+			continue;
+		}
+
+		x = ReportPredictAxis(Predictor, slot, &slot->X, &slot->VelocityX, &slot->AccelerationX,
+			Cache->Slot[i].x, slot->Samples != 0 ? intervalUs : 0);
+		y = ReportPredictAxis(Predictor, slot, &slot->Y, &slot->VelocityY, &slot->AccelerationY,
+			Cache->Slot[i].y, slot->Samples != 0 ? intervalUs : 0);
+
+		if (slot->Samples == 0 || intervalUs != 0)
+		{
+			slot->Samples = min(slot->Samples + 1, 3);
+		}
+
+		Cache->Slot[i].x = (int)((x + 128) >> 8);
+		Cache->Slot[i].y = (int)((y + 128) >> 8);
+	}
+
+	Predictor->SlotValid = Cache->SlotValid;
+}
+
+static VOID
+ReportRejectPalms(
+	IN REPORT_PALM* Palm,
+	IN OBJECT_CACHE* Cache
+)
+/*++
+
+Routine Description:
+
+	Classifies the contacts of the frame as fingers or palms from their
+	area and pressure, and decides how each one goes into the finger
+	report. Palms are either reported without confidence until they lift,
+	or left out entirely; a palm the host already saw as a finger is
+	reported lifted once before it disappears.
+
+Arguments:
+
+	Palm - Palm rejection state
+	Cache - Local object cache, updated for this frame
+
+Return Value:
+
+	None.
+
+--*/
+{
+	unsigned long live = Cache->SlotValid | Cache->SlotDirty;
+	unsigned long i;
+	UINT32 bit;
+	BOOLEAN large;
+	BOOLEAN small;
+
+	Palm->Hidden = 0;
+	Palm->NoConfidence = 0;
+	Palm->Cancelled = 0;
+
+	if (Palm->Mode == REPORT_PALM_OFF)
+	{
+		return;
+	}
+
+	//
+	// Contacts that went down in this frame start out as fingers
+	//
+	Palm->Palm &= Palm->SlotValid;
+	Palm->Reported &= Palm->SlotValid;
+
+	for (i = find_first_bit(&live, MAX_TOUCHES);
+		i < MAX_TOUCHES;
+		i = find_next_bit(&live, MAX_TOUCHES, i + 1))
+	{
+		bit = 1 << i;
+
+		if (!(Cache->SlotDirty & bit) &&
+			Cache->Slot[i].status != OBJECT_STATE_PEN_PRESENT_WITH_TIP &&
+			Cache->Slot[i].status != OBJECT_STATE_PEN_PRESENT_WITH_ERASER)
+		{
+			large = Cache->Slot[i].area >= Palm->AreaThreshold ||
+				(Palm->WeightThreshold != 0 && Cache->Slot[i].weight >= Palm->WeightThreshold);
+			small = Cache->Slot[i].area < Palm->AreaRelease &&
+				(Palm->WeightThreshold == 0 || Cache->Slot[i].weight < Palm->WeightRelease);
+
+			if (!(Palm->Palm & bit))
+			{
+				if (large)
+				{
+					Palm->Palm |= bit;
+					Palm->Rejected++;
+				}
+			}
+			else if (small && !(Palm->Reported & bit))
+			{
+				//
+				// Only a palm the host does not see can turn back into a
+				// finger, it then goes down as a new contact
+				//
+				if (++Palm->ReleaseFrames[i] >= REPORT_PALM_RELEASE_FRAMES)
+				{
+					Palm->Palm &= ~bit;
+				}
+			}
+			else
+			{
+				Palm->ReleaseFrames[i] = 0;
+			}
+
+			if (!(Palm->Palm & bit))
+			{
+				Palm->ReleaseFrames[i] = 0;
+			}
+		}
+
+		if (Palm->Palm & bit)
+		{
+			if (Palm->Mode == REPORT_PALM_CLEAR_CONFIDENCE)
+			{
+				Palm->NoConfidence |= bit;
+				Palm->Reported |= bit;
+			}
+			else if (Palm->Reported & bit)
+			{
+				Palm->NoConfidence |= bit;
+				Palm->Cancelled |= bit;
+				Palm->Reported &= ~bit;
+			}
+			else
+			{
+				Palm->Hidden |= bit;
+			}
+		}
+		else
+		{
+			Palm->Reported |= bit;
+		}
+
+		//
+		// Lifted contacts are reported as long as the host saw them down,
+		// their state ends with this frame
+		//
+		if (Cache->SlotDirty & bit)
+		{
+			Palm->Palm &= ~bit;
+			Palm->Reported &= ~bit;
+			Palm->ReleaseFrames[i] = 0;
+		}
+	}
+
+	Palm->SlotValid = Cache->SlotValid;
+}
+
+static BOOLEAN
+ReportIsStationary(
+	IN REPORT_SUPPRESSION* Suppression,
+	IN PHID_TOUCH_REPORT TouchReport,
+	IN LONGLONG Now
+)
+/*++
+
+Routine Description:
+
+	Decides whether a finger report adds nothing to the last one sent: the
+	same contacts in the same order with the same tip and confidence, each within
+	the position thresholds, and the keep-alive interval not yet expired.
+
+--*/
+{
+	PHID_TOUCH_REPORT last = &Suppression->LastReport;
+	int i;
+
+	if (!Suppression->Enabled ||
+		last->ContactCount == 0 ||
+		last->ContactCount != TouchReport->ContactCount ||
+		Now - Suppression->LastReportTime >= Suppression->KeepAlive)
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < TouchReport->ContactCount; i++)
+	{
+		PHID_TOUCH_FINGER previous = &last->Contacts[i];
+		PHID_TOUCH_FINGER current = &TouchReport->Contacts[i];
+
+		if (previous->ContactID != current->ContactID ||
+			previous->TipSwitch != current->TipSwitch ||
+			previous->Confidence != current->Confidence ||
+			abs((int)previous->X - (int)current->X) > Suppression->ThresholdX ||
+			abs((int)previous->Y - (int)current->Y) > Suppression->ThresholdY)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+NTSTATUS
+ReportObjectsInternal(
+	IN PREPORT_CONTEXT ReportContext,
+	IN DETECTED_OBJECTS data
+)
+/*++
+
+Routine Description:
+
+	Called when a touch interrupt needs service.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current SPB context (I2C, etc)
+	HidReport- Buffer to fill with a hid report if touch data is available
+	InputMode - Specifies mouse, single-touch, or multi-touch reporting modes
+	PendingTouches - Notifies caller if there are more touches to report, to
+		complete reporting the full state of fingers on the screen
+
+Return Value:
+
+	NTSTATUS indicating whether or not the current hid report buffer was filled
+
+	PendingTouches also indicates whether the caller should expect more than
+		one request to be completed to indicate the full state of fingers on
+		the screen
+--*/
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	HID_INPUT_REPORT HidReport;
+	int TouchesReported = 0;
+	int ContactsReported = 0;
+	int ContactCount;
+	int currentFingerIndex;
+	int fingersToReport = 0;
+	USHORT ScratchX[MAX_TOUCHES];
+	USHORT ScratchY[MAX_TOUCHES];
+	UCHAR Weights[MAX_TOUCHES];
+	UCHAR Areas[MAX_TOUCHES];
+	HID_INPUT_REPORT PackedReport;
+	PHID_INPUT_REPORT Report;
+	BOOLEAN HasPen = FALSE;
+
+	//
+	// Process the new touch data by updating our cached state
+	//
+	ReportUpdateLocalObjectCache(
+		&data,
+		&ReportContext->Cache);
+
+	ReportFilterObjects(
+		&ReportContext->Filter,
+		&ReportContext->Cache,
+		data.Timestamp.QuadPart);
+
+	ReportPredictObjects(
+		&ReportContext->Predictor,
+		&ReportContext->Cache,
+		data.Lifted,
+		data.Timestamp.QuadPart);
+
+	ReportRejectPalms(
+		&ReportContext->Palm,
+		&ReportContext->Cache);
+
+	ContactCount = ReportContext->Cache.DownCount - (int)hweight32(ReportContext->Palm.Hidden);
+
+	//
+	// If no touches are present return that no data needed to be reported
 	//
-	// If no touches are present return that no data needed to be reported
-	//
-	if (ReportContext->Cache.DownCount == 0)
+	if (ContactCount == 0)
 	{
+		ReportRemoveLiftedObjects(&ReportContext->Cache);
 		status = STATUS_NO_DATA_DETECTED;
 		goto exit;
 	}
 
-	while (TouchesReported != ReportContext->Cache.DownCount)
+	while (ContactsReported != ContactCount)
 	{
 		//
 		// Fill report with the next cached touches
 		//
 		RtlZeroMemory(&HidReport, sizeof(HID_INPUT_REPORT));
+		RtlZeroMemory(Weights, sizeof(Weights));
+		RtlZeroMemory(Areas, sizeof(Areas));
 
 		currentFingerIndex = 0;
 
-		fingersToReport = min(ReportContext->Cache.DownCount - TouchesReported, 10);
+		fingersToReport = min(ContactCount - ContactsReported, (int)ReportContext->ContactsPerReport);
 
 		HidReport.ReportID = REPORTID_FINGER;
 
 		//
 		// There are only 16-bits for ScanTime, truncate it
 		//
-		//HidReport->ScanTime = Cache->ScanTime & 0xFFFF;
+		HidReport.TouchReport.ScanTime = (USHORT)(ReportContext->Cache.ScanTime & 0xFFFF);
+#ifdef _TIMESTAMP_
+		HidReport.TimeStamp = data.Timestamp;
+#endif
 
 		//
 		// Report the count
-		// We're sending touches using hybrid mode with 5 fingers in our
-		// report descriptor. The first report must indicate the
+		// In hybrid mode the report descriptor declares fewer contacts
+		// than can be down at once. The first report must indicate the
 		// total count of touch fingers detected by the digitizer.
 		// The remaining reports must indicate 0 for the count.
 		// The first report will have the TouchesReported integer set to 0
 		// The others will have it set to something else.
 		//
-		if (TouchesReported == 0)
+		if (ContactsReported == 0)
 		{
-			HidReport.TouchReport.ContactCount = (UCHAR)ReportContext->Cache.DownCount;
+			HidReport.TouchReport.ContactCount = (UCHAR)ContactCount;
 		}
 		else
 		{
@@ -407,12 +1599,20 @@ Return Value:
 
 		HasPen = FALSE;
 
-		for (currentFingerIndex = 0; currentFingerIndex < fingersToReport; currentFingerIndex++)
+		for (currentFingerIndex = 0; currentFingerIndex < fingersToReport; TouchesReported++)
 		{
-			int currentlyReporting = ReportContext->Cache.DownOrder[TouchesReported];
+			int currentlyReporting = OBJECT_CACHE_DOWN_ORDER(&ReportContext->Cache, TouchesReported);
 
 			OBJECT_INFO info = ReportContext->Cache.Slot[currentlyReporting];
 
+			//
+			// Rejected palms the host never saw stay out of the report
+			//
+			if (ReportContext->Palm.Hidden & (1 << currentlyReporting))
+			{
+				continue;
+			}
+
 			if (info.status == OBJECT_STATE_PEN_PRESENT_WITH_ERASER ||
 				info.status == OBJECT_STATE_PEN_PRESENT_WITH_TIP)
 			{
@@ -444,26 +1644,41 @@ Return Value:
 			}
 
 			HidReport.TouchReport.Contacts[currentFingerIndex].ContactID = (UCHAR)currentlyReporting;
-			SctatchX = (USHORT)info.x;
-			ScratchY = (USHORT)info.y;
-			HidReport.TouchReport.Contacts[currentFingerIndex].Confidence = 1;
-
-			//
-			// Perform per-platform x/y adjustments to controller coordinates
-			//
-			/*TchTranslateToDisplayCoordinates(
-				&SctatchX,
-				&ScratchY,
-				&ReportContext->Props);*/
-
-			if (info.status == OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS)
+			ScratchX[currentFingerIndex] = (USHORT)info.x;
+			ScratchY[currentFingerIndex] = (USHORT)info.y;
+			Weights[currentFingerIndex] = info.weight;
+			Areas[currentFingerIndex] = info.area;
+			HidReport.TouchReport.Contacts[currentFingerIndex].Confidence =
+				(UCHAR)!(ReportContext->Palm.NoConfidence & (1 << currentlyReporting));
+
+			if (info.status == OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS &&
+				!(ReportContext->Palm.Cancelled & (1 << currentlyReporting)))
 			{
-				HidReport.TouchReport.Contacts[currentFingerIndex].X = SctatchX;
-				HidReport.TouchReport.Contacts[currentFingerIndex].Y = ScratchY;
 				HidReport.TouchReport.Contacts[currentFingerIndex].TipSwitch = FINGER_STATUS;
 			}
 
-			TouchesReported++;
+			currentFingerIndex++;
+			ContactsReported++;
+		}
+
+		//
+		// Perform per-platform x/y adjustments to controller coordinates
+		// for all contacts of the report at once
+		//
+		TchTransformToDisplayCoordinates(
+			ScratchX,
+			ScratchY,
+			(ULONG)fingersToReport,
+			&ReportContext->Props);
+
+		//
+		// A lifted contact is reported once more at its last position
+		// with the tip switch cleared
+		//
+		for (currentFingerIndex = 0; currentFingerIndex < fingersToReport; currentFingerIndex++)
+		{
+			HidReport.TouchReport.Contacts[currentFingerIndex].X = ScratchX[currentFingerIndex];
+			HidReport.TouchReport.Contacts[currentFingerIndex].Y = ScratchY[currentFingerIndex];
 		}
 
 		if (HasPen == FALSE && ReportContext->PenPresent == TRUE)
@@ -495,7 +1710,30 @@ Return Value:
 			}
 		}
 
-		status = TchSendReport(ReportContext->PingPongQueue, &HidReport);
+		//
+		// Resting contacts produce the same report every scan, only send
+		// one when something moved, changed state or the keep-alive expired.
+		// Frames split over several reports are always sent
+		//
+		if (ContactCount <= (int)ReportContext->ContactsPerReport &&
+			ReportIsStationary(
+				&ReportContext->Suppression,
+				&HidReport.TouchReport,
+				data.Timestamp.QuadPart))
+		{
+			ReportContext->Suppression.Suppressed++;
+			continue;
+		}
+
+		Report = &HidReport;
+		if (ReportContext->ContactSize ||
+			ReportContext->ContactsPerReport != MAX_TOUCHES)
+		{
+			ReportPackFingers(ReportContext, &HidReport, Weights, Areas, &PackedReport);
+			Report = &PackedReport;
+		}
+
+		status = ReportQueueHidReport(ReportContext, Report);
 
 		if (!NT_SUCCESS(status))
 		{
@@ -507,85 +1745,226 @@ Return Value:
 
 			goto exit;
 		}
+
+		if (ContactCount <= (int)ReportContext->ContactsPerReport)
+		{
+			RtlCopyMemory(
+				&ReportContext->Suppression.LastReport,
+				&HidReport.TouchReport,
+				sizeof(HID_TOUCH_REPORT));
+			ReportContext->Suppression.LastReportTime = data.Timestamp.QuadPart;
+		}
+		else
+		{
+			ReportContext->Suppression.LastReport.ContactCount = 0;
+		}
 	}
 
+	//
+	// Every lift has been reported with the tip switch cleared, drop the
+	// lifted contacts now rather than on the next frame
+	//
+	ReportRemoveLiftedObjects(&ReportContext->Cache);
+
 exit:
 	return status;
 }
 
-NTSTATUS
+static LONG
+ReportContinuousPeriodMs(
+	IN REPORT_CONTINUOUS* Continuous
+)
+/*++
+
+Routine Description:
+
+	Returns the re-send period, the measured scan period clamped to a sane
+	range, or the maximum until the scan rate is known.
+
+--*/
+{
+	LONGLONG period;
+
+	if (Continuous->ScanPeriod == 0)
+	{
+		return REPORT_CONTINUOUS_MAX_PERIOD_MS;
+	}
+
+	period = (Continuous->ScanPeriod * 1000) / Continuous->Frequency;
+
+	return (LONG)max(REPORT_CONTINUOUS_MIN_PERIOD_MS,
+		min(REPORT_CONTINUOUS_MAX_PERIOD_MS, period));
+}
+
+VOID
 TchContinuousObjectInterruptServicingEvtTimerFunc(
 	IN WDFTIMER Timer
 )
+/*++
+
+Routine Description:
+
+	Republishes the last frame when the controller has not sent a new one
+	within a scan period. Runs at passive level so it can take the interrupt
+	lock, which keeps it and the ISR a single producer for the object cache
+	and the pending report ring.
+
+--*/
 {
-	NTSTATUS status = STATUS_SUCCESS;
+	NTSTATUS status;
+	PREPORT_CONTEXT ReportContext;
+	REPORT_CONTINUOUS* Continuous;
+	DETECTED_OBJECTS frame;
+	LONGLONG lastFrameTime;
+	LONGLONG periodTicks;
+	LONGLONG elapsed;
+	LONG periodMs;
+	LONG sequence;
+
+	ReportContext = GetReportTimerContext(Timer)->ReportContext;
+	Continuous = &ReportContext->Continuous;
 
-	Trace(
-            TRACE_LEVEL_ERROR,
-		TRACE_REPORTING,
-		"TchContinuousObjectInterruptServicingEvtTimerFunc ENTRY");
+	//
+	// The device left D0, there is nothing to republish
+	//
+	if (Continuous->Stopped)
+	{
+		goto exit;
+	}
 
-      if (cachedReportContext == NULL)
-      {
-		Trace(
-			TRACE_LEVEL_ERROR,
-			TRACE_REPORTING,
-			"Error while reporting objects - cachedReportContext is NULL");
+	//
+	// Snapshot the last frame without the lock. An update in progress or
+	// one that completed while copying means a real frame just arrived and
+	// the ISR has re-armed the timer itself
+	//
+	sequence = Continuous->Sequence;
+	KeMemoryBarrier();
+
+	if (sequence & 1)
+	{
+		Continuous->Suppressed++;
+		goto exit;
+	}
+
+	RtlCopyMemory(&frame, &Continuous->Frame, sizeof(frame));
+	lastFrameTime = Continuous->LastFrameTime;
+	KeMemoryBarrier();
 
-            WdfTimerStop(Timer, FALSE);
+	if (Continuous->Sequence != sequence)
+	{
+		Continuous->Suppressed++;
 		goto exit;
-      }
+	}
+
+	periodMs = ReportContinuousPeriodMs(Continuous);
+	periodTicks = (periodMs * Continuous->Frequency) / 1000;
+	elapsed = KeQueryPerformanceCounter(NULL).QuadPart - lastFrameTime;
+
+	//
+	// A real frame arrived within the period, wait for the rest of it
+	//
+	if (elapsed < periodTicks)
+	{
+		Continuous->Suppressed++;
+		WdfTimerStart(
+			Timer,
+			WDF_REL_TIMEOUT_IN_MS(
+				max(1, ((periodTicks - elapsed) * 1000) / Continuous->Frequency)));
+		goto exit;
+	}
+
+	WdfInterruptAcquireLock(Continuous->Interrupt);
+
+	if (Continuous->Stopped || Continuous->Sequence != sequence)
+	{
+		WdfInterruptReleaseLock(Continuous->Interrupt);
+		Continuous->Suppressed++;
+		goto exit;
+	}
+
+	//
+	// A repeated frame is a new scan as far as the touch stack is concerned
+	//
+	frame.Timestamp = KeQueryPerformanceCounter(NULL);
 
 	status = ReportObjectsInternal(
-		cachedReportContext,
-		objectData);
+		ReportContext,
+		frame);
+
+	WdfInterruptReleaseLock(Continuous->Interrupt);
 
+	ReportTraceVerbose(
+		ReportContext,
+		REPORT_TRACE_EVENT_CONTINUOUS_RESEND,
+		0,
+		(ULONG)periodMs,
+		(ULONG)status);
+
+	//
+	// Stop once every contact has been lifted
+	//
 	if (!NT_SUCCESS(status))
 	{
 		Trace(
-			TRACE_LEVEL_ERROR,
+			TRACE_LEVEL_VERBOSE,
 			TRACE_REPORTING,
-			"Error while reporting objects - 0x%08lX",
+			"Stopping continuous reporting - 0x%08lX",
 			status);
 
-            WdfTimerStop(Timer, FALSE);
-            status = STATUS_SUCCESS;
 		goto exit;
 	}
 
-exit:
-	Trace(
-            TRACE_LEVEL_ERROR,
-		TRACE_REPORTING,
-		"TchContinuousObjectInterruptServicingEvtTimerFunc EXIT - 0x%08lX",
-		status);
+	Continuous->Resent++;
+	WdfTimerStart(Timer, WDF_REL_TIMEOUT_IN_MS(periodMs));
 
-	return status;
+exit:
+	return;
 }
 
 NTSTATUS
 ReportConfigureContinuousSimulationTimer(
-	IN WDFDEVICE DeviceHandle
+	IN PREPORT_CONTEXT ReportContext,
+	IN WDFDEVICE DeviceHandle,
+	IN WDFINTERRUPT Interrupt
 )
 {
 	NTSTATUS status = STATUS_SUCCESS;
+	REPORT_CONTINUOUS* Continuous = &ReportContext->Continuous;
+	LARGE_INTEGER frequency;
 
 	WDF_TIMER_CONFIG  timerConfig;
 	WDF_OBJECT_ATTRIBUTES  timerAttributes;
 
+	//
+	// The timer lives as long as the device, hardware may be prepared
+	// more than once
+	//
+	if (Continuous->Timer != NULL)
+	{
+		goto exit;
+	}
+
+	KeQueryPerformanceCounter(&frequency);
+	Continuous->Frequency = frequency.QuadPart;
+	Continuous->Interrupt = Interrupt;
+
+	//
+	// One shot, re-armed by whoever last reported a frame
+	//
 	WDF_TIMER_CONFIG_INIT(
-      	&timerConfig,
-      	TchContinuousObjectInterruptServicingEvtTimerFunc);
+		&timerConfig,
+		TchContinuousObjectInterruptServicingEvtTimerFunc);
 
-      timerConfig.Period = 50;
+	timerConfig.AutomaticSerialization = FALSE;
 
-      WDF_OBJECT_ATTRIBUTES_INIT(&timerAttributes);
-      timerAttributes.ParentObject = DeviceHandle;
+	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&timerAttributes, REPORT_TIMER_CONTEXT);
+	timerAttributes.ParentObject = DeviceHandle;
+	timerAttributes.ExecutionLevel = WdfExecutionLevelPassive;
 
 	status = WdfTimerCreate(
-      	&timerConfig,
-      	&timerAttributes,
-      	&timerHandle);
+		&timerConfig,
+		&timerAttributes,
+		&Continuous->Timer);
 
 	if (!NT_SUCCESS(status))
 	{
@@ -598,33 +1977,352 @@ ReportConfigureContinuousSimulationTimer(
 		goto exit;
 	}
 
+	GetReportTimerContext(Continuous->Timer)->ReportContext = ReportContext;
+
 exit:
 	return status;
 }
 
+VOID
+ReportConfigureSuppression(
+	IN PREPORT_CONTEXT ReportContext,
+	IN BOOLEAN Enabled,
+	IN UINT32 ThresholdX,
+	IN UINT32 ThresholdY,
+	IN UINT32 KeepAliveMs
+)
+/*++
+
+Routine Description:
+
+	Sets up suppression of finger reports for resting contacts.
+
+Arguments:
+
+	ReportContext - Report context
+	Enabled - TRUE to suppress reports that repeat the last one sent
+	ThresholdX - Movement in display pixels below which X is unchanged
+	ThresholdY - Movement in display pixels below which Y is unchanged
+	KeepAliveMs - Longest time a suppressed report is held back
+
+Return Value:
+
+	None.
+
+--*/
+{
+	REPORT_SUPPRESSION* Suppression = &ReportContext->Suppression;
+	LARGE_INTEGER frequency;
+
+	KeQueryPerformanceCounter(&frequency);
+
+	RtlZeroMemory(Suppression, sizeof(*Suppression));
+	Suppression->Enabled = Enabled;
+	Suppression->ThresholdX = (USHORT)min(ThresholdX, MAXUSHORT);
+	Suppression->ThresholdY = (USHORT)min(ThresholdY, MAXUSHORT);
+	Suppression->KeepAlive = (KeepAliveMs * frequency.QuadPart) / 1000;
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_INIT,
+		"Stationary report suppression %d, threshold %d,%d, keep-alive %dms",
+		Enabled,
+		ThresholdX,
+		ThresholdY,
+		KeepAliveMs);
+}
+
+VOID
+ReportConfigureFilter(
+	IN PREPORT_CONTEXT ReportContext,
+	IN UINT32 AbsPosFilt
+)
+/*++
+
+Routine Description:
+
+	Sets up the position filter from the AbsPosFilt setting. Zero disables
+	the filter, otherwise bits 0-7 hold the minimum cutoff in 0.1 Hz and
+	bits 8-15 the speed coefficient in 0.0001 Hz per pixel/s, e.g. 0x460A
+	for a 1 Hz cutoff and a 0.007 coefficient.
+
+Arguments:
+
+	ReportContext - Report context
+	AbsPosFilt - Encoded filter parameters
+
+Return Value:
+
+	None.
+
+--*/
+{
+	REPORT_FILTER* Filter = &ReportContext->Filter;
+	LARGE_INTEGER frequency;
+
+	KeQueryPerformanceCounter(&frequency);
+
+	RtlZeroMemory(Filter, sizeof(*Filter));
+	Filter->MinCutoff = (AbsPosFilt & 0xFF) * 100;
+	Filter->Beta = (AbsPosFilt >> 8) & 0xFF;
+	Filter->Frequency = frequency.QuadPart;
+	Filter->Enabled = Filter->MinCutoff != 0;
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_INIT,
+		"Position filter %d, min cutoff %dmHz, beta %d",
+		Filter->Enabled,
+		Filter->MinCutoff,
+		Filter->Beta);
+}
+
+VOID
+ReportConfigurePredictor(
+	IN PREPORT_CONTEXT ReportContext,
+	IN UINT32 HorizonMs,
+	IN UINT32 MaxDistance,
+	IN UINT32 VelocityGain,
+	IN UINT32 AccelerationGain
+)
+/*++
+
+Routine Description:
+
+	Sets up position prediction for resting and moving contacts.
+
+Arguments:
+
+	ReportContext - Report context
+	HorizonMs - How far ahead to predict, zero disables prediction
+	MaxDistance - Largest correction applied to a contact, in pixels
+	VelocityGain - Weight of the velocity term in percent
+	AccelerationGain - Weight of the acceleration term in percent
+
+Return Value:
+
+	None.
+
+--*/
+{
+	REPORT_PREDICTOR* Predictor = &ReportContext->Predictor;
+	LARGE_INTEGER frequency;
+
+	KeQueryPerformanceCounter(&frequency);
+
+	RtlZeroMemory(Predictor, sizeof(*Predictor));
+	Predictor->HorizonUs = min(HorizonMs, REPORT_PREDICTOR_MAX_HORIZON_MS) * 1000;
+	Predictor->MaxDistance = (LONGLONG)min(MaxDistance, MAXUSHORT) << 8;
+	Predictor->VelocityGain = min(VelocityGain, 200);
+	Predictor->AccelerationGain = min(AccelerationGain, 200);
+	Predictor->Frequency = frequency.QuadPart;
+	Predictor->Enabled = Predictor->HorizonUs != 0;
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_INIT,
+		"Position prediction %d, horizon %dms, max distance %d, gains %d%%/%d%%",
+		Predictor->Enabled,
+		HorizonMs,
+		MaxDistance,
+		Predictor->VelocityGain,
+		Predictor->AccelerationGain);
+}
+
+VOID
+ReportConfigurePalmRejection(
+	IN PREPORT_CONTEXT ReportContext,
+	IN UINT32 Mode,
+	IN UINT32 AreaThreshold,
+	IN UINT32 WeightThreshold
+)
+/*++
+
+Routine Description:
+
+	Sets up palm and large-blob rejection.
+
+Arguments:
+
+	ReportContext - Report context
+	Mode - REPORT_PALM_OFF, REPORT_PALM_CLEAR_CONFIDENCE or
+		REPORT_PALM_SUPPRESS
+	AreaThreshold - Contact area (0-15) from which a contact is a palm
+	WeightThreshold - Contact pressure from which a contact is a palm,
+		zero to only look at the area
+
+Return Value:
+
+	None.
+
+--*/
+{
+	REPORT_PALM* Palm = &ReportContext->Palm;
+
+	RtlZeroMemory(Palm, sizeof(*Palm));
+	Palm->Mode = Mode <= REPORT_PALM_SUPPRESS ? Mode : REPORT_PALM_OFF;
+	Palm->AreaThreshold = (UCHAR)min(max(AreaThreshold, 1UL), 15UL);
+	Palm->AreaRelease = (UCHAR)(Palm->AreaThreshold - min(Palm->AreaThreshold, REPORT_PALM_AREA_HYSTERESIS));
+	Palm->WeightThreshold = (UCHAR)min(WeightThreshold, 255UL);
+	Palm->WeightRelease = (UCHAR)(Palm->WeightThreshold - Palm->WeightThreshold / 4);
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_INIT,
+		"Palm rejection mode %d, area %d/%d, weight %d/%d",
+		Palm->Mode,
+		Palm->AreaThreshold,
+		Palm->AreaRelease,
+		Palm->WeightThreshold,
+		Palm->WeightRelease);
+}
+
+VOID
+ReportConfigureFingerReports(
+	IN PREPORT_CONTEXT ReportContext,
+	IN BOOLEAN ContactSize,
+	IN UINT32 ContactsPerReport
+)
+/*++
+
+Routine Description:
+
+	Selects the finger report layout: whether reports carry contact width,
+	height and pressure, and how many contacts each report holds. Frames
+	with more contacts down are split over several reports (hybrid mode).
+	Must be set before HIDClass reads the report descriptor.
+
+Arguments:
+
+	ReportContext - Report context
+	ContactSize - TRUE to report contact size and pressure
+	ContactsPerReport - Contacts per finger report, zero for MAX_TOUCHES
+
+Return Value:
+
+	None.
+
+--*/
+{
+	if (ContactsPerReport == 0 || ContactsPerReport > MAX_TOUCHES)
+	{
+		ContactsPerReport = MAX_TOUCHES;
+	}
+
+	ReportContext->ContactSize = ContactSize;
+	ReportContext->ContactsPerReport = ContactsPerReport;
+	ReportContext->FingerContactLength = (ULONG)(ContactSize ?
+		sizeof(HID_TOUCH_FINGER_EX) :
+		sizeof(HID_TOUCH_FINGER));
+	ReportContext->FingerReportLength = (ULONG)HID_FINGER_REPORT_LENGTH(ContactsPerReport, ContactSize);
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_INIT,
+		"Contact size reporting %d, %d contacts per report of %d bytes",
+		ContactSize,
+		ContactsPerReport,
+		ReportContext->FingerReportLength);
+}
+
+VOID
+ReportStartContinuousSimulation(
+	IN PREPORT_CONTEXT ReportContext
+)
+/*++
+
+Routine Description:
+
+	Lets frames re-arm the re-send timer again once the device is back in
+	D0. The timer itself is started by the next frame.
+
+--*/
+{
+	ReportContext->Continuous.Stopped = FALSE;
+}
+
+VOID
+ReportStopContinuousSimulation(
+	IN PREPORT_CONTEXT ReportContext
+)
+/*++
+
+Routine Description:
+
+	Cancels any pending re-send and waits for a running one to finish, then
+	forgets the last frame and the measured scan rate so nothing from
+	before is replayed. The interrupt lock is taken first so an ISR still
+	running finishes before the timer is stopped and cannot re-arm it
+	afterwards. Must not be called with the interrupt lock held.
+
+--*/
+{
+	REPORT_CONTINUOUS* Continuous = &ReportContext->Continuous;
+
+	if (Continuous->Timer == NULL)
+	{
+		return;
+	}
+
+	WdfInterruptAcquireLock(Continuous->Interrupt);
+
+	Continuous->Stopped = TRUE;
+
+	InterlockedIncrement(&Continuous->Sequence);
+	RtlZeroMemory(&Continuous->Frame, sizeof(Continuous->Frame));
+	Continuous->LastFrameTime = 0;
+	Continuous->ScanPeriod = 0;
+	InterlockedIncrement(&Continuous->Sequence);
+
+	WdfInterruptReleaseLock(Continuous->Interrupt);
+
+	WdfTimerStop(Continuous->Timer, TRUE);
+}
+
 NTSTATUS
 ReportObjectsContinuous(
 	IN PREPORT_CONTEXT ReportContext,
 	IN DETECTED_OBJECTS data
 )
 {
-      NTSTATUS status = STATUS_SUCCESS;
+	NTSTATUS status = STATUS_SUCCESS;
+	REPORT_CONTINUOUS* Continuous = &ReportContext->Continuous;
+	LONGLONG now;
+	LONGLONG delta;
 
-	Trace(
-            TRACE_LEVEL_ERROR,
-		TRACE_REPORTING,
-		"ReportObjectsContinuous ENTRY");
+	now = data.Timestamp.QuadPart;
+	if (now == 0)
+	{
+		now = KeQueryPerformanceCounter(NULL).QuadPart;
+	}
+
+	//
+	// Publish the frame for the timer. Gaps longer than the maximum period
+	// are the controller idling, not its scan rate
+	//
+	InterlockedIncrement(&Continuous->Sequence);
 
-      WdfTimerStop(timerHandle, TRUE);
+	delta = now - Continuous->LastFrameTime;
+	if (Continuous->LastFrameTime != 0 && delta > 0 &&
+		delta <= (REPORT_CONTINUOUS_MAX_PERIOD_MS * Continuous->Frequency) / 1000)
+	{
+		Continuous->ScanPeriod = Continuous->ScanPeriod == 0 ? delta :
+			(Continuous->ScanPeriod * 7 + delta) / 8;
+	}
 
-      cachedReportContext = ReportContext;
+	Continuous->LastFrameTime = now;
+	RtlCopyMemory(&Continuous->Frame, &data, sizeof(Continuous->Frame));
 
-      RtlCopyMemory(&objectData, &data, sizeof(objectData));
+	InterlockedIncrement(&Continuous->Sequence);
 
 	status = ReportObjectsInternal(
 		ReportContext,
-		objectData);
+		data);
 
+	//
+	// Never wait for the timer here, its callback may be blocked on the
+	// interrupt lock this ISR is holding
+	//
 	if (!NT_SUCCESS(status))
 	{
 		Trace(
@@ -633,17 +2331,24 @@ ReportObjectsContinuous(
 			"Error while reporting objects - 0x%08lX",
 			status);
 
+		WdfTimerStop(Continuous->Timer, FALSE);
 		goto exit;
 	}
 
-	WdfTimerStart(timerHandle, WDF_REL_TIMEOUT_IN_MS(50));
+	if (!Continuous->Stopped)
+	{
+		WdfTimerStart(
+			Continuous->Timer,
+			WDF_REL_TIMEOUT_IN_MS(ReportContinuousPeriodMs(Continuous)));
+	}
 
-exit:	
-      Trace(
-            TRACE_LEVEL_ERROR,
-		TRACE_REPORTING,
-		"ReportObjectsContinuous EXIT - 0x%08lX",
-		status);
+exit:
+	ReportTraceVerbose(
+		ReportContext,
+		REPORT_TRACE_EVENT_CONTINUOUS_FRAME,
+		0,
+		(ULONG)Continuous->ScanPeriod,
+		(ULONG)status);
 
 	return status;
 }
@@ -404,6 +404,245 @@ TchTranslateToDisplayCoordinates(
     *PY = (USHORT) Y;
 }
 
+static BOOLEAN
+TchBuildTransformScale(
+    IN ULONG MaxInput,
+    IN ULONG Multiplier,
+    IN ULONG Divisor,
+    OUT TOUCH_TRANSFORM_AXIS *Axis
+    )
+/*++
+
+  Routine Description:
+
+    Replaces Input * Multiplier / Divisor with a multiply by a fixed-point
+    reciprocal and a shift. With the dividend below 2^N and the divisor
+    below 2^L, a reciprocal rounded up to N + L bits gives the exact
+    quotient for every dividend in range.
+
+  Return Value:
+
+    FALSE if the dividend range is too wide for a 64-bit product.
+
+--*/
+{
+    ULONGLONG maxDividend;
+    ULONGLONG reciprocal;
+    ULONG dividendBits;
+    ULONG divisorBits;
+
+    if (Divisor == 0)
+    {
+        return FALSE;
+    }
+
+    //
+    // The generic path multiplies in 32 bits, stay clear of its overflow
+    //
+    maxDividend = (ULONGLONG)MaxInput * Multiplier;
+    if (maxDividend >= 0x80000000ULL)
+    {
+        return FALSE;
+    }
+
+    dividendBits = (ULONG)RtlFindMostSignificantBit(maxDividend | 1) + 1;
+    divisorBits = Divisor == 1 ? 0 :
+        (ULONG)RtlFindMostSignificantBit(Divisor - 1) + 1;
+
+    reciprocal = ((1ULL << (dividendBits + divisorBits)) + Divisor - 1) / Divisor;
+
+    Axis->ScaleMultiplier = reciprocal * Multiplier;
+    Axis->ScaleShift = dividendBits + divisorBits;
+
+    return TRUE;
+}
+
+static VOID
+TchBuildTransform(
+    IN PTOUCH_SCREEN_PROPERTIES Props
+    )
+/*++
+
+  Routine Description:
+
+    Compiles the screen properties into the transform applied by
+    TchTransformToDisplayCoordinates. The result matches
+    TchTranslateToDisplayCoordinates for every input.
+
+  Arguments:
+
+    Props - screen information, receives the transform
+
+  Return Value:
+
+    None. Transform.Valid is cleared if the properties cannot be expressed.
+
+--*/
+{
+    TOUCH_TRANSFORM *transform = &Props->Transform;
+    TOUCH_TRANSFORM_AXIS *axisX = &transform->Axis[0];
+    TOUCH_TRANSFORM_AXIS *axisY = &transform->Axis[1];
+    ULONG sourceX = Props->TouchSwapAxes ? 1 : 0;
+    ULONG sourceY = Props->TouchSwapAxes ? 0 : 1;
+
+    RtlZeroMemory(transform, sizeof(*transform));
+
+    //
+    // Reject what the clip and scale steps rely on not happening: empty
+    // ranges, clip margins wider than the range, and zero divisors
+    //
+    if (Props->TouchPhysicalWidth == 0 ||
+        Props->TouchPhysicalHeight <= Props->TouchPhysicalButtonHeight ||
+        Props->TouchPillarBoxWidthRight > Props->TouchPhysicalWidth ||
+        Props->TouchLetterBoxHeightBottom > Props->TouchPhysicalHeight ||
+        Props->DisplayPillarBoxWidthRight > Props->DisplayPhysicalWidth ||
+        Props->DisplayLetterBoxHeightBottom > Props->DisplayPhysicalHeight)
+    {
+        goto exit;
+    }
+
+    //
+    // Swap and invert. An inverted axis is clamped to its last pixel first
+    //
+    transform->InputMax[sourceX] = MAXUSHORT;
+    axisX->Matrix[sourceX] = 1;
+    if (Props->TouchInvertXAxis)
+    {
+        transform->InputMax[sourceX] = Props->TouchPhysicalWidth - 1;
+        axisX->Matrix[sourceX] = -1;
+        axisX->Matrix[2] = Props->TouchPhysicalWidth - 1;
+    }
+
+    transform->InputMax[sourceY] = MAXUSHORT;
+    axisY->Matrix[sourceY] = 1;
+    if (Props->TouchInvertYAxis)
+    {
+        transform->InputMax[sourceY] = Props->TouchPhysicalHeight - 1;
+        axisY->Matrix[sourceY] = -1;
+        axisY->Matrix[2] = Props->TouchPhysicalHeight - 1;
+    }
+
+    //
+    // Clip to the physical display, which leaves the coordinate in
+    // [0, TouchPhysicalWidth/Height] for the scale
+    //
+    axisX->TouchClipLow = Props->TouchPillarBoxWidthLeft;
+    axisX->TouchShift = (LONGLONG)Props->TouchPillarBoxWidthRight -
+        Props->TouchPillarBoxWidthLeft;
+    axisX->TouchClipHigh = Props->TouchPhysicalWidth;
+
+    axisY->TouchClipLow = Props->TouchLetterBoxHeightTop;
+    axisY->TouchShift = (LONGLONG)Props->TouchLetterBoxHeightBottom -
+        Props->TouchLetterBoxHeightTop;
+    axisY->TouchClipHigh = Props->TouchPhysicalHeight;
+
+    if (!TchBuildTransformScale(
+            Props->TouchPhysicalWidth,
+            Props->DisplayPhysicalWidth,
+            Props->TouchPhysicalWidth,
+            axisX) ||
+        !TchBuildTransformScale(
+            Props->TouchPhysicalHeight,
+            Props->DisplayPhysicalHeight,
+            Props->TouchPhysicalHeight - Props->TouchPhysicalButtonHeight,
+            axisY))
+    {
+        goto exit;
+    }
+
+    axisX->DisplayClipLow = Props->DisplayPillarBoxWidthLeft;
+    axisX->DisplayShift = (LONGLONG)Props->DisplayPillarBoxWidthRight -
+        Props->DisplayPillarBoxWidthLeft;
+    axisX->DisplayClipHigh = Props->DisplayPhysicalWidth;
+
+    axisY->DisplayClipLow = Props->DisplayLetterBoxHeightTop;
+    axisY->DisplayShift = (LONGLONG)Props->DisplayLetterBoxHeightBottom -
+        Props->DisplayLetterBoxHeightTop;
+    axisY->DisplayClipHigh = Props->DisplayPhysicalHeight;
+
+    transform->Valid = TRUE;
+
+exit:
+    if (!transform->Valid)
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_REGISTRY,
+            "Screen properties not expressible as a fixed-point transform");
+    }
+}
+
+VOID
+TchTransformToDisplayCoordinates(
+    IN OUT PUSHORT X,
+    IN OUT PUSHORT Y,
+    IN ULONG Count,
+    IN PTOUCH_SCREEN_PROPERTIES Props
+    )
+/*++
+
+  Routine Description:
+
+    Translates a batch of touch coordinates to display pixels with the
+    transform built by TchGetScreenProperties. Gives the same results as
+    calling TchTranslateToDisplayCoordinates on each point.
+
+  Arguments:
+
+    X - array of Count X coordinates, translated in place
+    Y - array of Count Y coordinates, translated in place
+    Count - number of points
+    Props - pointer to screen information
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    TOUCH_TRANSFORM *transform = &Props->Transform;
+    LONGLONG input[2];
+    LONGLONG value;
+    USHORT output[2];
+    ULONG axis;
+    ULONG i;
+
+    if (!transform->Valid)
+    {
+        for (i = 0; i < Count; i++)
+        {
+            TchTranslateToDisplayCoordinates(&X[i], &Y[i], Props);
+        }
+
+        return;
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        input[0] = min((LONGLONG)X[i], transform->InputMax[0]);
+        input[1] = min((LONGLONG)Y[i], transform->InputMax[1]);
+
+        for (axis = 0; axis < 2; axis++)
+        {
+            const TOUCH_TRANSFORM_AXIS *t = &transform->Axis[axis];
+
+            value =
+                t->Matrix[0] * input[0] +
+                t->Matrix[1] * input[1] +
+                t->Matrix[2];
+
+            value = min(max(value, t->TouchClipLow) + t->TouchShift, t->TouchClipHigh);
+            value = (LONGLONG)(((ULONGLONG)value * t->ScaleMultiplier) >> t->ScaleShift);
+            value = min(max(value, t->DisplayClipLow) + t->DisplayShift, t->DisplayClipHigh);
+
+            output[axis] = (USHORT)value;
+        }
+
+        X[i] = output[0];
+        Y[i] = output[1];
+    }
+}
+
 VOID
 TchGetScreenProperties(
     IN PTOUCH_SCREEN_PROPERTIES Props
@@ -528,6 +767,8 @@ TchGetScreenProperties(
             gDefaultProperties.TouchLetterBoxHeightBottom;
     }
 
+    TchBuildTransform(Props);
+
     if (regTable != NULL)
     {
         ExFreePoolWithTag(regTable, TOUCH_POOL_TAG);
@@ -27,12 +27,84 @@
 #include <reshub.h>
 #include <spb.tmh>
 
-static void crckermit(UINT8* data, UINT32 len, UINT16* crc_out)
+//
+// CRC-16/Kermit (reflected polynomial 0x8408) lookup tables. Table 0 is the
+// classic byte-wise table, tables 1..N-1 advance the remainder by one more
+// zero byte each so N input bytes can be folded per iteration.
+//
+#if FTS_CRC_SLICE_BY > 0
+static UINT16 gCrcKermitTable[FTS_CRC_SLICE_BY][256];
+static BOOLEAN gCrcKermitTableReady = FALSE;
+#endif
+
+static void crckermit_init(void)
 {
+#if FTS_CRC_SLICE_BY > 0
     UINT32 i = 0;
+    UINT32 k = 0;
     UINT16 j = 0;
+    UINT16 crc = 0;
+
+    if (gCrcKermitTableReady) {
+        return;
+    }
+
+    for (i = 0; i < 256; i++) {
+        crc = (UINT16)i;
+        for (j = 0; j < 8; j++) {
+            if (crc & 0x01)
+                crc = (UINT16)((crc >> 1) ^ 0x8408);
+            else
+                crc = (crc >> 1);
+        }
+        gCrcKermitTable[0][i] = crc;
+    }
+
+    for (k = 1; k < FTS_CRC_SLICE_BY; k++) {
+        for (i = 0; i < 256; i++) {
+            crc = gCrcKermitTable[k - 1][i];
+            gCrcKermitTable[k][i] = (UINT16)((crc >> 8) ^ gCrcKermitTable[0][crc & 0xFF]);
+        }
+    }
+
+    gCrcKermitTableReady = TRUE;
+#endif
+}
+
+static void crckermit(UINT8* data, UINT32 len, UINT16* crc_out)
+{
+    UINT32 i = 0;
     UINT16 crc = 0xFFFF;
 
+#if FTS_CRC_SLICE_BY == 8
+    for (; i + 8 <= len; i += 8) {
+        crc ^= (UINT16)(data[i] | (data[i + 1] << 8));
+        crc = (UINT16)(gCrcKermitTable[7][crc & 0xFF] ^
+            gCrcKermitTable[6][crc >> 8] ^
+            gCrcKermitTable[5][data[i + 2]] ^
+            gCrcKermitTable[4][data[i + 3]] ^
+            gCrcKermitTable[3][data[i + 4]] ^
+            gCrcKermitTable[2][data[i + 5]] ^
+            gCrcKermitTable[1][data[i + 6]] ^
+            gCrcKermitTable[0][data[i + 7]]);
+    }
+#elif FTS_CRC_SLICE_BY == 4
+    for (; i + 4 <= len; i += 4) {
+        crc ^= (UINT16)(data[i] | (data[i + 1] << 8));
+        crc = (UINT16)(gCrcKermitTable[3][crc & 0xFF] ^
+            gCrcKermitTable[2][crc >> 8] ^
+            gCrcKermitTable[1][data[i + 2]] ^
+            gCrcKermitTable[0][data[i + 3]]);
+    }
+#endif
+
+#if FTS_CRC_SLICE_BY > 0
+    for (; i < len; i++) {
+        crc = (UINT16)((crc >> 8) ^ gCrcKermitTable[0][(crc ^ data[i]) & 0xFF]);
+    }
+#else
+    UINT16 j = 0;
+
     for (i = 0; i < len; i++) {
         crc ^= data[i];
         for (j = 0; j < 8; j++) {
@@ -42,6 +114,7 @@ static void crckermit(UINT8* data, UINT32 len, UINT16* crc_out)
                 crc = (crc >> 1);
         }
     }
+#endif
 
     *crc_out = crc;
 }
@@ -60,9 +133,40 @@ static int rdata_check(UINT8* rdata, UINT32 rlen)
     return 0;
 }
 
+static NTSTATUS SpbGetTransferBuffers(
+    IN SPB_CONTEXT* SpbContext,
+    IN UINT32 Length,
+    OUT PUCHAR* BufferWrite,
+    OUT PUCHAR* BufferRead
+)
+/*++
+
+  Routine Description:
+
+    Returns the default write/read buffers. Transfers that do not fit them
+    are a caller bug and are rejected, see FTS_MAX_TRANSFER_LENGTH. Must be
+    called with SpbLock held.
+
+--*/
+{
+    SpbContext->Transfers++;
+
+    if (Length > DEFAULT_SPB_BUFFER_SIZE)
+    {
+        SpbContext->Rejected++;
+        Trace(TRACE_LEVEL_ERROR, TRACE_SPB, "Spb transfer of %u bytes exceeds the default buffers", Length);
+        NT_ASSERTMSG("Spb transfer exceeds the default buffers", FALSE);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *BufferWrite = (PUCHAR)WdfMemoryGetBuffer(SpbContext->WriteMemory, NULL);
+    *BufferRead = (PUCHAR)WdfMemoryGetBuffer(SpbContext->ReadMemory, NULL);
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS FTS_Read(IN SPB_CONTEXT* SpbContext, IN UINT8* cmd, OUT UINT8* data, IN UINT32 datalen) {
     NTSTATUS status;
-    WDFMEMORY memoryRead = NULL, memoryWrite = NULL;
     PUCHAR bufferRead, bufferWrite;
     WDF_MEMORY_DESCRIPTOR memoryDescriptor;
     UINT32 txlen = 0;
@@ -71,39 +175,10 @@ NTSTATUS FTS_Read(IN SPB_CONTEXT* SpbContext, IN UINT8* cmd, OUT UINT8* data, IN
     UINT32 dp = 0;
 
     WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
-    if (txlen_need > DEFAULT_SPB_BUFFER_SIZE)
+    status = SpbGetTransferBuffers(SpbContext, txlen_need, &bufferWrite, &bufferRead);
+    if (!NT_SUCCESS(status))
     {
-        status = WdfMemoryCreate(
-            WDF_NO_OBJECT_ATTRIBUTES,
-            NonPagedPool,
-            TOUCH_POOL_TAG,
-            txlen_need,
-            &memoryWrite,
-            &bufferWrite);
-
-        if (!NT_SUCCESS(status))
-        {
-            Trace(TRACE_LEVEL_ERROR, TRACE_SPB, "Error allocating memory for Spb write - 0x%08lX", status);
-            goto exit;
-        }
-
-        status = WdfMemoryCreate(
-            WDF_NO_OBJECT_ATTRIBUTES,
-            NonPagedPool,
-            TOUCH_POOL_TAG,
-            txlen_need,
-            &memoryRead,
-            &bufferRead);
-
-        if (!NT_SUCCESS(status))
-        {
-            Trace(TRACE_LEVEL_ERROR, TRACE_SPB, "Error allocating memory for Spb read - 0x%08lX", status);
-            goto exit;
-        }
-    }
-    else {
-        bufferWrite = (PUCHAR)WdfMemoryGetBuffer(SpbContext->WriteMemory, NULL);
-        bufferRead = (PUCHAR)WdfMemoryGetBuffer(SpbContext->ReadMemory, NULL);
+        goto exit;
     }
 
     bufferWrite[txlen++] = cmd[0];
@@ -165,7 +240,6 @@ NTSTATUS FTS_Read(IN SPB_CONTEXT* SpbContext, IN UINT8* cmd, OUT UINT8* data, IN
                 status = STATUS_DATA_ERROR;
                 continue;
             }
-            Trace(TRACE_LEVEL_INFORMATION, TRACE_SPB, "CRC check OK");
             status = STATUS_SUCCESS;
             break;
         }
@@ -174,22 +248,12 @@ NTSTATUS FTS_Read(IN SPB_CONTEXT* SpbContext, IN UINT8* cmd, OUT UINT8* data, IN
         }
     }
 exit:
-    if (NULL != memoryRead)
-    {
-        WdfObjectDelete(memoryRead);
-    }
-
-    if (NULL != memoryWrite)
-    {
-        WdfObjectDelete(memoryWrite);
-    }
     WdfWaitLockRelease(SpbContext->SpbLock);
     return status;
 }
 
 NTSTATUS FTS_Write(IN SPB_CONTEXT* SpbContext, IN UINT8* cmd, IN UINT32 writelen) {
     NTSTATUS status;
-    WDFMEMORY memoryRead = NULL, memoryWrite = NULL;
     PUCHAR bufferRead, bufferWrite;
     WDF_MEMORY_DESCRIPTOR memoryDescriptor;
     UINT32 txlen = 0;
@@ -197,40 +261,10 @@ NTSTATUS FTS_Write(IN SPB_CONTEXT* SpbContext, IN UINT8* cmd, IN UINT32 writelen
     UINT32 datalen = writelen - 1;
 
     WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
-    if (txlen_need > DEFAULT_SPB_BUFFER_SIZE)
-    {
-        status = WdfMemoryCreate(
-            WDF_NO_OBJECT_ATTRIBUTES,
-            NonPagedPool,
-            TOUCH_POOL_TAG,
-            txlen_need,
-            &memoryWrite,
-            &bufferWrite);
-
-        if (!NT_SUCCESS(status))
-        {
-            Trace(TRACE_LEVEL_ERROR, TRACE_SPB, "Error allocating memory for Spb write - 0x%08lX", status);
-            goto exit;
-        }
-
-        status = WdfMemoryCreate(
-            WDF_NO_OBJECT_ATTRIBUTES,
-            NonPagedPool,
-            TOUCH_POOL_TAG,
-            txlen_need,
-            &memoryRead,
-            &bufferRead);
-
-        if (!NT_SUCCESS(status))
-        {
-            Trace(TRACE_LEVEL_ERROR, TRACE_SPB, "Error allocating memory for Spb read - 0x%08lX", status);
-            goto exit;
-        }
-    }
-    else
+    status = SpbGetTransferBuffers(SpbContext, txlen_need, &bufferWrite, &bufferRead);
+    if (!NT_SUCCESS(status))
     {
-        bufferWrite = (PUCHAR)WdfMemoryGetBuffer(SpbContext->WriteMemory, NULL);
-        bufferRead = (PUCHAR)WdfMemoryGetBuffer(SpbContext->ReadMemory, NULL);
+        goto exit;
     }
 
     bufferWrite[txlen++] = cmd[0];
@@ -289,15 +323,88 @@ NTSTATUS FTS_Write(IN SPB_CONTEXT* SpbContext, IN UINT8* cmd, IN UINT32 writelen
     }
 
 exit:
-    if (NULL != memoryRead)
-    {
-        WdfObjectDelete(memoryRead);
+    WdfWaitLockRelease(SpbContext->SpbLock);
+    return status;
+}
+
+NTSTATUS FTS_WriteGather(IN SPB_CONTEXT* SpbContext, IN UINT8 cmd, IN UINT8* data, IN UINT32 datalen) {
+    NTSTATUS status = STATUS_SUCCESS;
+    PUCHAR bufferRead, bufferWrite;
+    WDF_MEMORY_DESCRIPTOR memoryDescriptor;
+    SPB_TRANSFER_BUFFER_LIST_ENTRY writeList[2];
+    UINT32 txlen = 0;
+
+    WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
+
+    //
+    // Only the header goes through the default buffers, the payload is sent
+    // straight from the caller's buffer. The read side is just as long as the
+    // header, the rest of what the device shifts out is discarded.
+    //
+    bufferWrite = (PUCHAR)WdfMemoryGetBuffer(SpbContext->WriteMemory, NULL);
+    bufferRead = (PUCHAR)WdfMemoryGetBuffer(SpbContext->ReadMemory, NULL);
+
+    bufferWrite[txlen++] = cmd;
+    bufferWrite[txlen++] = 0x00;
+    bufferWrite[txlen++] = (datalen >> 8) & 0xFF;
+    bufferWrite[txlen++] = datalen & 0xFF;
+    if (datalen > 0) {
+        bufferWrite[txlen++] = 0x00;
+        bufferWrite[txlen++] = 0x00;
+        bufferWrite[txlen++] = 0x00;
     }
 
-    if (NULL != memoryWrite)
+    writeList[0].Buffer = bufferWrite;
+    writeList[0].BufferCb = (ULONG)txlen;
+    writeList[1].Buffer = data;
+    writeList[1].BufferCb = (ULONG)datalen;
+
+    SPB_TRANSFER_LIST_AND_ENTRIES(2) seq;
+    SPB_TRANSFER_LIST_INIT(&(seq.List), 2);
+
     {
-        WdfObjectDelete(memoryWrite);
+        ULONG index = 0;
+        seq.List.Transfers[index] = SPB_TRANSFER_LIST_ENTRY_INIT_BUFFER_LIST(
+            SpbTransferDirectionToDevice,
+            0,
+            writeList,
+            datalen > 0 ? 2 : 1
+        );
+        seq.List.Transfers[index + 1] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+            SpbTransferDirectionFromDevice,
+            0,
+            bufferRead,
+            (ULONG)txlen
+        );
     }
+
+    WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+        &memoryDescriptor,
+        &seq,
+        sizeof(seq)
+    );
+
+    for (int i = 0; i < 5; i++) {
+        status = WdfIoTargetSendIoctlSynchronously(
+            SpbContext->SpbIoTarget,
+            NULL,
+            IOCTL_SPB_FULL_DUPLEX,
+            &memoryDescriptor,
+            NULL,
+            NULL,
+            NULL
+        );
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_SPB, "Failed to send ioctl - 0x%08lX", status);
+            continue;
+        }
+        if ((bufferRead[3] & 0xA0) == 0) {
+            Trace(TRACE_LEVEL_INFORMATION, TRACE_SPB, "Write OK");
+            break;
+        }
+        Trace(TRACE_LEVEL_ERROR, TRACE_SPB, "data write status 0x%X, retry: %d", bufferRead[3], i);
+    }
+
     WdfWaitLockRelease(SpbContext->SpbLock);
     return status;
 }
@@ -439,6 +546,12 @@ SpbTargetInitialize(
         goto exit;
     }
 
+    //
+    // Build the CRC lookup tables used to validate every read before the
+    // first transfer is issued
+    //
+    crckermit_init();
+
     //
     // Allocate some fixed-size buffers from NonPagedPool for typical
     // Spb transaction sizes to avoid pool fragmentation in most cases